@@ -57,6 +57,10 @@ class Camera {
         glm::mat4 get_view_matrix();
         glm::mat4 get_projection_matrix();
 
+        // Ratio between half the screen height and the size of an object, at
+        // unit distance in perspective projection or at any distance otherwise
+        float get_projection_scale();
+
         void set_position(float x, float y, float z);
         void set_position(glm::vec4 position);
         glm::vec4 get_position();
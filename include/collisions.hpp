@@ -20,6 +20,24 @@ class AABB {
         }
 };
 
+// Transforms an AABB and returns the AABB that encloses the result
+AABB transform_aabb(const AABB& aabb, const glm::mat4& transform);
+
+// View frustum, as six planes pointing inwards
+class Frustum {
+    public:
+        Frustum() = default;
+
+        // Planes are extracted from the rows of the view-projection matrix
+        Frustum(const glm::mat4& view_projection);
+
+        // Returns false only when the AABB is completely outside a plane
+        bool intersects(const AABB& aabb) const;
+
+    private:
+        glm::vec4 planes[6];
+};
+
 glm::vec4 cursor_to_ray(glm::vec2 cursor_pos,
                         glm::vec2 window_size,
                         glm::mat4 projection_matrix,
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Reports changes to a set of files without blocking. Uses inotify on
+// Linux and compares modification times elsewhere.
+class FileWatcher {
+    public:
+        FileWatcher(std::vector<std::string> paths);
+        ~FileWatcher();
+
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+
+        // Returns true once after files changed, when no further change was
+        // seen for a short while, so that editors can finish writing them
+        bool poll();
+
+    private:
+        std::vector<std::filesystem::path> paths;
+
+        bool changed = false;
+        std::chrono::steady_clock::time_point last_change;
+
+        // Returns true when a change happened since the last call
+        bool read_changes();
+
+#ifdef __linux__
+        int inotify_fd = -1;
+        std::vector<int> watch_descriptors;
+#else
+        std::vector<std::filesystem::file_time_type> write_times;
+#endif
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+// First attribute locations used by the per-instance matrices
+// The model matrix uses 4 locations and the normal matrix uses 3
+#define INSTANCE_TRANSFORM_LOCATION 4
+#define INSTANCE_NORMAL_MATRIX_LOCATION 8
+
+// Vertex buffer binding point of the instance data, with direct state access
+#define INSTANCE_BUFFER_BINDING 4
+
+// Per-instance data read by the vertex shader, computed on the CPU
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normal_matrix;
+};
+
+// Interleaved vertex of the pool, with the attributes at locations 0 to 3
+// of "shader_vertex.glsl"
+struct PoolVertex {
+    glm::vec4 position;
+    glm::vec4 normal;
+    glm::vec2 texcoords;
+    glm::vec4 tangent;
+};
+
+// Draw read by glMultiDrawElementsIndirect, in the layout defined by OpenGL
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+// Vertex and index buffers shared by all models when multi-draw indirect is
+// available. Every model is drawn through the same VAO, so the opaque
+// geometry of a program can be drawn by a single call.
+// The buffers are filled by the loader thread when it is running.
+class GeometryPool {
+    public:
+        static bool is_enabled();
+
+        // Return the base vertex and the first index of the added data
+        static GLint add_vertices(const std::vector<PoolVertex>& vertices);
+        static GLuint add_indices(const std::vector<GLuint>& indices);
+
+        static GLuint get_vao();
+
+    private:
+        static GLuint vao_id;
+        static GLuint vertex_buffer_id;
+        static GLuint index_buffer_id;
+
+        static GLsizeiptr num_vertices;
+        static GLsizeiptr vertex_capacity;
+        static GLsizeiptr num_indices;
+        static GLsizeiptr index_capacity;
+
+        static void create();
+        static void set_vertex_attributes();
+
+        // Copies the used part of a buffer into a new one with room for at
+        // least the requested size, returning the new buffer
+        static GLuint grow(GLuint buffer_id, GLsizeiptr used_size, GLsizeiptr& capacity, GLsizeiptr required_size);
+
+        static void write(GLuint buffer_id, GLintptr offset, GLsizeiptr size, const void* data);
+};
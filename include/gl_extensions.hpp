@@ -0,0 +1,156 @@
+#pragma once
+
+#include <glad/gl.h>
+
+// OpenGL functions newer than 3.3, which GLAD was not generated for. They
+// are loaded by GlExtensions::load() and may only be called when the flag
+// of their group is set.
+
+// GL_ARB_get_program_binary, core since OpenGL 4.1
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void (GLAD_API_PTR *PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (GLAD_API_PTR *PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (GLAD_API_PTR *PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+extern PFNGLGETPROGRAMBINARYPROC glad_glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC glad_glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC glad_glProgramParameteri;
+
+#define glGetProgramBinary glad_glGetProgramBinary
+#define glProgramBinary glad_glProgramBinary
+#define glProgramParameteri glad_glProgramParameteri
+#endif
+
+// GL_KHR_parallel_shader_compile
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+typedef void (GLAD_API_PTR *PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR;
+
+#define glMaxShaderCompilerThreadsKHR glad_glMaxShaderCompilerThreadsKHR
+#endif
+
+// GL_ARB_multi_draw_indirect, core since OpenGL 4.3. The base instance of the
+// commands needs GL_ARB_base_instance, core since 4.2.
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+
+typedef void (GLAD_API_PTR *PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+
+extern PFNGLMULTIDRAWELEMENTSINDIRECTPROC glad_glMultiDrawElementsIndirect;
+
+#define glMultiDrawElementsIndirect glad_glMultiDrawElementsIndirect
+#endif
+
+// GL_ARB_buffer_storage, core since OpenGL 4.4
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+
+typedef void (GLAD_API_PTR *PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+extern PFNGLBUFFERSTORAGEPROC glad_glBufferStorage;
+
+#define glBufferStorage glad_glBufferStorage
+#endif
+
+// GL_ARB_direct_state_access, core since OpenGL 4.5. Immutable storage of
+// buffers and textures also needs GL_ARB_buffer_storage and
+// GL_ARB_texture_storage, core since 4.4 and 4.2.
+#ifndef GL_TEXTURE_TARGET
+#define GL_TEXTURE_TARGET 0x1006
+
+typedef void (GLAD_API_PTR *PFNGLCREATEBUFFERSPROC)(GLsizei n, GLuint *buffers);
+typedef void (GLAD_API_PTR *PFNGLNAMEDBUFFERSTORAGEPROC)(GLuint buffer, GLsizeiptr size, const void *data, GLbitfield flags);
+typedef void (GLAD_API_PTR *PFNGLNAMEDBUFFERDATAPROC)(GLuint buffer, GLsizeiptr size, const void *data, GLenum usage);
+typedef void (GLAD_API_PTR *PFNGLNAMEDBUFFERSUBDATAPROC)(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data);
+typedef void (GLAD_API_PTR *PFNGLCOPYNAMEDBUFFERSUBDATAPROC)(GLuint readBuffer, GLuint writeBuffer, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size);
+typedef void (GLAD_API_PTR *PFNGLCREATEVERTEXARRAYSPROC)(GLsizei n, GLuint *arrays);
+typedef void (GLAD_API_PTR *PFNGLENABLEVERTEXARRAYATTRIBPROC)(GLuint vaobj, GLuint index);
+typedef void (GLAD_API_PTR *PFNGLVERTEXARRAYATTRIBFORMATPROC)(GLuint vaobj, GLuint attribindex, GLint size, GLenum type, GLboolean normalized, GLuint relativeoffset);
+typedef void (GLAD_API_PTR *PFNGLVERTEXARRAYATTRIBBINDINGPROC)(GLuint vaobj, GLuint attribindex, GLuint bindingindex);
+typedef void (GLAD_API_PTR *PFNGLVERTEXARRAYBINDINGDIVISORPROC)(GLuint vaobj, GLuint bindingindex, GLuint divisor);
+typedef void (GLAD_API_PTR *PFNGLVERTEXARRAYVERTEXBUFFERPROC)(GLuint vaobj, GLuint bindingindex, GLuint buffer, GLintptr offset, GLsizei stride);
+typedef void (GLAD_API_PTR *PFNGLVERTEXARRAYELEMENTBUFFERPROC)(GLuint vaobj, GLuint buffer);
+typedef void (GLAD_API_PTR *PFNGLCREATETEXTURESPROC)(GLenum target, GLsizei n, GLuint *textures);
+typedef void (GLAD_API_PTR *PFNGLTEXTURESTORAGE2DPROC)(GLuint texture, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+typedef void (GLAD_API_PTR *PFNGLTEXTURESTORAGE3DPROC)(GLuint texture, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth);
+typedef void (GLAD_API_PTR *PFNGLTEXTURESUBIMAGE2DPROC)(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels);
+typedef void (GLAD_API_PTR *PFNGLTEXTURESUBIMAGE3DPROC)(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels);
+typedef void (GLAD_API_PTR *PFNGLTEXTUREPARAMETERIPROC)(GLuint texture, GLenum pname, GLint param);
+typedef void (GLAD_API_PTR *PFNGLBINDTEXTUREUNITPROC)(GLuint unit, GLuint texture);
+
+extern PFNGLCREATEBUFFERSPROC glad_glCreateBuffers;
+extern PFNGLNAMEDBUFFERSTORAGEPROC glad_glNamedBufferStorage;
+extern PFNGLNAMEDBUFFERDATAPROC glad_glNamedBufferData;
+extern PFNGLNAMEDBUFFERSUBDATAPROC glad_glNamedBufferSubData;
+extern PFNGLCOPYNAMEDBUFFERSUBDATAPROC glad_glCopyNamedBufferSubData;
+extern PFNGLCREATEVERTEXARRAYSPROC glad_glCreateVertexArrays;
+extern PFNGLENABLEVERTEXARRAYATTRIBPROC glad_glEnableVertexArrayAttrib;
+extern PFNGLVERTEXARRAYATTRIBFORMATPROC glad_glVertexArrayAttribFormat;
+extern PFNGLVERTEXARRAYATTRIBBINDINGPROC glad_glVertexArrayAttribBinding;
+extern PFNGLVERTEXARRAYBINDINGDIVISORPROC glad_glVertexArrayBindingDivisor;
+extern PFNGLVERTEXARRAYVERTEXBUFFERPROC glad_glVertexArrayVertexBuffer;
+extern PFNGLVERTEXARRAYELEMENTBUFFERPROC glad_glVertexArrayElementBuffer;
+extern PFNGLCREATETEXTURESPROC glad_glCreateTextures;
+extern PFNGLTEXTURESTORAGE2DPROC glad_glTextureStorage2D;
+extern PFNGLTEXTURESTORAGE3DPROC glad_glTextureStorage3D;
+extern PFNGLTEXTURESUBIMAGE2DPROC glad_glTextureSubImage2D;
+extern PFNGLTEXTURESUBIMAGE3DPROC glad_glTextureSubImage3D;
+extern PFNGLTEXTUREPARAMETERIPROC glad_glTextureParameteri;
+extern PFNGLBINDTEXTUREUNITPROC glad_glBindTextureUnit;
+
+#define glCreateBuffers glad_glCreateBuffers
+#define glNamedBufferStorage glad_glNamedBufferStorage
+#define glNamedBufferData glad_glNamedBufferData
+#define glNamedBufferSubData glad_glNamedBufferSubData
+#define glCopyNamedBufferSubData glad_glCopyNamedBufferSubData
+#define glCreateVertexArrays glad_glCreateVertexArrays
+#define glEnableVertexArrayAttrib glad_glEnableVertexArrayAttrib
+#define glVertexArrayAttribFormat glad_glVertexArrayAttribFormat
+#define glVertexArrayAttribBinding glad_glVertexArrayAttribBinding
+#define glVertexArrayBindingDivisor glad_glVertexArrayBindingDivisor
+#define glVertexArrayVertexBuffer glad_glVertexArrayVertexBuffer
+#define glVertexArrayElementBuffer glad_glVertexArrayElementBuffer
+#define glCreateTextures glad_glCreateTextures
+#define glTextureStorage2D glad_glTextureStorage2D
+#define glTextureStorage3D glad_glTextureStorage3D
+#define glTextureSubImage2D glad_glTextureSubImage2D
+#define glTextureSubImage3D glad_glTextureSubImage3D
+#define glTextureParameteri glad_glTextureParameteri
+#define glBindTextureUnit glad_glBindTextureUnit
+#endif
+
+class GlExtensions {
+    public:
+        // Must be called after gladLoadGL(), with the context current
+        static void load(GLADloadfunc load);
+
+        // Programs can be saved and restored as driver specific binaries
+        static bool program_binary;
+
+        // Shaders compile on driver threads, and programs can be asked
+        // whether compilation finished without waiting for it
+        static bool parallel_shader_compile;
+
+        // Many indexed draws can be read from a buffer by a single call
+        static bool multi_draw_indirect;
+
+        // Buffers can stay mapped while the GPU reads from them
+        static bool buffer_storage;
+
+        // Buffers, textures and vertex arrays are edited by name, without
+        // binding them, and are created with immutable storage
+        static bool direct_state_access;
+
+    private:
+        static bool has_version(GLint major, GLint minor);
+        static bool has_extension(const char* name);
+};
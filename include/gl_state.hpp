@@ -0,0 +1,92 @@
+#pragma once
+
+#include <unordered_map>
+
+#include <glad/gl.h>
+
+// Cache of the OpenGL fixed-function state and object bindings.
+// All subsystems should change state through it, so that calls that would
+// not change anything are never sent to the driver.
+// Each thread has its own cache, for the context current on it.
+class GlState {
+    public:
+        static void enable(GLenum capability);
+        static void disable(GLenum capability);
+        static void set_enabled(GLenum capability, bool enabled);
+
+        static void blend_func(GLenum source_factor, GLenum destination_factor);
+        static void depth_func(GLenum func);
+        static void depth_mask(GLboolean mask);
+
+        // Enables or disables writes to all color channels at once
+        static void color_mask(GLboolean mask);
+        static void polygon_mode(GLenum mode);
+
+        static void use_program(GLuint program_id);
+        static void bind_vertex_array(GLuint vao_id);
+
+        // GL_ELEMENT_ARRAY_BUFFER is part of the VAO state and is never filtered
+        static void bind_buffer(GLenum target, GLuint buffer_id);
+        static void bind_buffer_base(GLenum target, GLuint index, GLuint buffer_id);
+        static void bind_buffer_range(GLenum target, GLuint index, GLuint buffer_id,
+                                      GLintptr offset, GLsizeiptr size);
+
+        static void active_texture(GLuint unit);
+
+        // Without direct state access the unit is also made active, even when
+        // the binding is cached, so the texture can be edited through it.
+        // With direct state access the active unit is left unchanged, and the
+        // texture must be edited by name.
+        static void bind_texture(GLuint unit, GLenum target, GLuint texture_id);
+        static void bind_sampler(GLuint unit, GLuint sampler_id);
+
+        // Should be called before deleting an object that may still be bound
+        static void forget_program(GLuint program_id);
+
+        // Deleting a bound buffer binds 0 in its place, and the name can be
+        // returned again by glGenBuffers
+        static void forget_buffer(GLuint buffer_id);
+        static void forget_vertex_array(GLuint vao_id);
+
+        // Number of state changes sent to the driver and filtered by the cache
+        static thread_local GLuint changes_issued;
+        static thread_local GLuint changes_filtered;
+        static thread_local GLuint changes_issued_last_frame;
+        static thread_local GLuint changes_filtered_last_frame;
+
+        // Should be called once at the end of every frame
+        static void end_frame();
+
+    private:
+        // Returns true when the cached value was updated and the call is needed
+        template<typename K, typename V>
+        static bool update(std::unordered_map<K, V>& cache, K key, V value);
+
+        static bool update(GLuint& cache, bool& known, GLuint value);
+
+        static thread_local std::unordered_map<GLenum, bool> capabilities;
+        static thread_local std::unordered_map<GLenum, GLuint> buffers;
+        static thread_local std::unordered_map<GLuint, GLuint> samplers;
+
+        // Bound textures, keyed by unit and target
+        static thread_local std::unordered_map<GLuint64, GLuint> textures;
+
+        static thread_local GLuint blend_source;
+        static thread_local GLuint blend_destination;
+        static thread_local GLuint depth_function;
+        static thread_local GLuint depth_write;
+        static thread_local GLuint color_write;
+        static thread_local GLuint polygon_fill_mode;
+        static thread_local GLuint program;
+        static thread_local GLuint vertex_array;
+        static thread_local GLuint texture_unit;
+
+        static thread_local bool blend_known;
+        static thread_local bool depth_function_known;
+        static thread_local bool depth_write_known;
+        static thread_local bool color_write_known;
+        static thread_local bool polygon_fill_mode_known;
+        static thread_local bool program_known;
+        static thread_local bool vertex_array_known;
+        static thread_local bool texture_unit_known;
+};
@@ -1,15 +1,23 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <future>
 #include <map>
+#include <memory>
+#include <optional>
 #include <queue>
 #include <string_view>
 #include <string>
+#include <vector>
 
 #include <glm/mat4x4.hpp>
 
 #include <glad/gl.h>
 
+#include "file_watcher.hpp"
+
 #define BOARD 0
 #define PIECE 1
 #define TABLE 2
@@ -27,44 +35,233 @@
 #define AVAILABLE_CAPTURE 5
 #define CHECK 6
 
+// Binding point of the "FrameUniforms" uniform block
+#define FRAME_UNIFORMS_BINDING 0
+
+// Largest piece of a texture level copied to the GPU at once. Bigger levels
+// are uploaded in bands of rows, possibly over several frames.
+#define TEXTURE_UPLOAD_CHUNK_SIZE (1 << 22)
+
 #define SQUARE_SIZE (0.05789)
 #define BOARD_START (-4 * SQUARE_SIZE)
 #define G_SQUARE_SIZE (SQUARE_SIZE * 1.5)
 #define G_BOARD_START (-4 * G_SQUARE_SIZE)
 
+// Data shared by all draws of a frame
+// Must match the std140 layout of the "FrameUniforms" block in the shaders
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 view_projection;
+    glm::vec4 camera_position;
+    glm::vec4 light_position;
+    glm::vec4 fog_color;
+};
+
+// Uniform block attached to a fixed binding point. Its data is written to
+// the stream buffer on every update, and the binding points to that range.
+class UniformBuffer {
+    public:
+        UniformBuffer(GLuint binding);
+
+        void update(const void* data, GLsizeiptr size);
+
+    private:
+        GLuint binding;
+};
+
+// Mipmap level stored in the pixels of a TextureData
+struct TextureLevel {
+    int width;
+    int height;
+    size_t offset;
+};
+
+// Texture decoded on a worker thread, with all its mipmap levels
 struct TextureData {
     std::string_view uniform_name;
-    unsigned char* data;
-    int width = 0;
-    int height = 0;
-    int channels = 3;
+    std::vector<unsigned char> pixels;
+    std::vector<TextureLevel> levels;
+
+    // Format of the texture and layout of the pixels given to OpenGL
+    GLenum internal_format = GL_SRGB8;
+    GLenum format = GL_RGB;
+    GLenum type = GL_UNSIGNED_BYTE;
+    int texel_size = 3;
+
+    // Replaces the texture already bound to the uniform, when uploaded
+    bool upgrade = false;
+
+    // Face of a cubemap, given by the layer, instead of a 2D texture
+    bool cubemap_face = false;
+
+    // Texture array and layer the texture is uploaded to
+    size_t array = 0;
+    GLint layer = 0;
+};
+
+// Textures of the same size and format are layers of one texture array,
+// bound to its own texture unit. Materials select their layer by index.
+// The six faces of a cubemap are held the same way, with one face per layer.
+struct TextureArray {
+    GLenum target;
+    GLuint texture_id;
+    GLuint unit;
+    GLsizeiptr memory;
+
+    // Textures currently sampled from the array, which is deleted when
+    // all of them have been replaced by higher resolution versions
+    GLuint num_users = 0;
+};
+
+// Uniform of a linked program, found by reflection after linking
+struct UniformInfo {
+    std::string name;
+    GLint location = -1;
+
+    // Last value sent to the program, used to skip redundant uploads
+    std::array<float, 16> value;
+    bool has_value = false;
 };
 
 class GpuProgram {
     private:
-        std::map<std::string, GLint> uniform_locations;
+        // Flat table of uniforms, indexed by the handles returned by
+        // get_uniform_handle(). Handles stay valid when shaders are reloaded.
+        std::vector<UniformInfo> uniforms;
+        std::map<std::string, GLint, std::less<>> uniform_handles;
+
+        void reflect_uniforms();
+
+        // Returns false when the upload can be skipped
+        bool update_uniform_cache(GLint handle, const void* value, size_t size);
+
+        std::string vertex_shader_path;
+        std::string fragment_shader_path;
+
+        // Preprocessor definitions injected in the sources of this program
+        std::vector<std::string> defines;
+
+        // Specialized programs compiled from the same sources, keyed by
+        // their definitions
+        std::map<std::string, std::unique_ptr<GpuProgram>> permutations;
+
+        static std::optional<std::string> read_shader_file(std::string_view filename,
+                                                           const std::vector<std::string>& defines);
+
+        // Compiling and linking only start the work in the driver, the
+        // results are queried by the check functions
+        static void compile_shader(GLuint shader_id, const std::string& source);
+        static bool check_shader(GLuint shader_id, const std::string& log_info);
+        static GLuint link_program(GLuint vertex_shader_id, GLuint fragment_shader_id);
+        static bool check_program(GLuint program_id);
+        static void release_shaders(GLuint program_id, GLuint vertex_shader_id, GLuint fragment_shader_id);
 
-        GLuint vertex_shader_id;
-        GLuint fragment_shader_id;
+        // Restores the program from the binary cache, or compiles and links
+        // it, waiting for the driver
+        void build_program(const std::string& vertex_source,
+                           const std::string& fragment_source,
+                           const std::string& vertex_log_info,
+                           const std::string& fragment_log_info);
 
-        static void load_shader_from_file(std::string_view filename, GLuint shader_id);
-        static void load_shader_from_source(const GLchar* const shader_string,
-                                            GLuint shader_id,
-                                            int shader_string_length = -1,
-                                            std::string log_info = "");
+        void setup_program();
 
-        void create_program();
+        // Program being built by a reload. It replaces the current program
+        // only if it links successfully, which is checked without waiting.
+        struct PendingProgram {
+            GLuint id = 0;
+            GLuint vertex_shader_id = 0;
+            GLuint fragment_shader_id = 0;
+            uint64_t cache_key = 0;
+            std::string vertex_log_info;
+            std::string fragment_log_info;
+            int polls = 0;
+
+            // Without KHR_parallel_shader_compile the loader thread compiles
+            // and links the program, setting it here, or 0 if it failed
+            std::shared_ptr<GLuint> loader_program;
+        };
+        std::optional<PendingProgram> pending_program;
+
+        // Whether update_reload() has a reload to finish
+        bool reloading = false;
+
+        // Programs that failed to link during the current reload
+        static GLuint failed_reloads;
+
+        std::unique_ptr<FileWatcher> shader_watcher;
+
+        void start_reload();
+        void start_loader_reload(PendingProgram pending,
+                                 std::string vertex_source,
+                                 std::string fragment_source);
+        void poll_reload();
+        void finish_reload();
+        void replace_program(GLuint program_id);
+        void discard_pending_reload();
+        bool is_reload_pending() const;
+
+        // Sets a sampler unit or layer uniform of this program and its permutations
+        void set_texture_uniform(std::string_view uniform, GLint value);
 
         std::vector<std::future<TextureData>> tex_futures;
         std::queue<TextureData> tex_queue;
 
-        std::vector<std::string_view> texture_uniforms;
+        // Decoded textures wait until every texture requested with them is
+        // decoded, so that each array is allocated with all of its layers.
+        // Cubemaps are allocated the same way, once all faces are decoded.
+        std::vector<TextureData> decoded_textures;
+
+        // Upload position of the texture at the front of the queue
+        size_t uploading_level = 0;
+        int uploading_row = 0;
+
+        std::vector<TextureArray> texture_arrays;
+
+        // Array currently sampled by each texture uniform
+        std::map<std::string_view, size_t, std::less<>> texture_array_indices;
+
+        // Units given to the cubemaps and to the arrays
+        GLuint num_texture_units = 0;
+
+        void decode_textures_async(std::vector<std::pair<std::string_view, std::string_view>> textures,
+                                   bool upgrade);
+
+        void allocate_texture_arrays();
+        void allocate_cubemap(std::vector<TextureData*>& faces);
+        void upload_texture_rows(const TextureData& tex, GLsizeiptr max_size);
+        void finish_texture_upload(const TextureData& tex);
+
+        // Textures of one array handed to the loader thread as a single job,
+        // with the number of mipmap levels the loader has uploaded so far
+        struct TextureUpload {
+            std::vector<TextureData> textures;
+            std::atomic<size_t> uploaded_levels = 0;
+        };
+
+        // Hands the queued textures to the loader thread, one job per array
+        void submit_texture_uploads();
+        std::vector<std::shared_ptr<TextureUpload>> texture_uploads;
+
+        // Pixel buffer the texture data is staged in, shared by all programs
+        static GLuint upload_pbo_id;
+
+        // Trilinear and anisotropic filtering, shared by all texture arrays
+        static GLuint array_sampler_id;
+
+        // Texture units and layers of the sampler uniforms, set again on
+        // permutations and after the program is linked again
+        std::vector<std::pair<std::string, GLint>> texture_uniforms;
 
     public:
         GLint id = 0;
 
+        // Name under which the draws of the program are timed on the GPU
+        std::string_view timer_scope = "other";
+
         GpuProgram(std::string_view vertex_shader_path = "../../src/shader_vertex.glsl",
-                   std::string_view fragment_shader_path = "../../src/shader_fragment.glsl");
+                   std::string_view fragment_shader_path = "../../src/shader_fragment.glsl",
+                   std::vector<std::string> defines = {});
 
         GpuProgram(const GLchar* const vertex_shader_source,
                    const GLchar* const fragment_shader_source);
@@ -74,16 +271,51 @@ class GpuProgram {
         void load_shaders_from_source(const GLchar* const vertex_shader_source,
                                       const GLchar* const fragment_shader_source);
 
+        // Starts compiling the shader files again, for this program and its
+        // permutations. The current programs are kept until the new ones link.
         void reload_shaders();
 
+        // Reloads the shaders whenever their files change
+        void watch_shader_files();
+
+        // Finishes reloads whose compilation is done, should be called every frame
+        // Returns whether a reload was in progress, including one just finished
+        bool update_reload();
+
+        // Returns the program compiled from the same files with the given
+        // definitions, such as "OBJECT_ID PIECE", sharing the textures of
+        // this one. Permutations are compiled on first use and then cached.
+        GpuProgram& get_permutation(std::vector<std::string> defines);
+
+        // Binds the program through the GlState cache
+        void use();
+        static void use_program(GLuint id);
+
         void set_uniform(std::string_view name, float value);
         void set_uniform(std::string_view name, int value);
         void set_uniform(std::string_view name, glm::vec2 value);
         void set_uniform(std::string_view name, glm::vec4 value);
         void set_uniform(std::string_view name, glm::mat4 value);
 
+        void set_uniform(GLint handle, float value);
+        void set_uniform(GLint handle, int value);
+        void set_uniform(GLint handle, glm::vec2 value);
+        void set_uniform(GLint handle, glm::vec4 value);
+        void set_uniform(GLint handle, glm::mat4 value);
+
+        GLint get_uniform_handle(std::string_view name);
         GLint get_uniform_location(std::string_view name);
 
+        // Number of uniform uploads skipped by the uniform cache, because the
+        // value did not change
+        static GLuint gl_calls_avoided;
+        static GLuint gl_calls_avoided_last_frame;
+
+        // Should be called once at the end of every frame
+        static void end_frame();
+
+        // Decodes the six faces of a cubemap on worker threads, in the order
+        // +X, -X, +Y, -Y, +Z, -Z, to be uploaded by upload_pending_textures()
         void load_cubemap_from_hdr_files(std::vector<std::string_view> filename,
                                          std::string_view uniform);
 
@@ -92,9 +324,32 @@ class GpuProgram {
         void load_textures_async(std::vector<std::pair<std::string_view, std::string_view>> textures);
 
         // Upload textures loaded async, should be called in the main loop
+        // Levels are uploaded until the time budget of the frame runs out, or
+        // by the loader thread when it is running
         // Returns true when all textures have been uploaded
         bool upload_pending_textures();
 
+        // Fraction of the textures uploaded, advancing with each mipmap level,
+        // whether it is uploaded by this thread or by the loader thread
+        float get_upload_progress() const;
+
+        // Loads higher resolution versions of textures already uploaded, from
+        // a vector of pairs: (filepath, uniform_name). Each one is uploaded
+        // through upload_pending_textures() into a new texture, which takes
+        // the place of the old one once all its levels are on the GPU.
+        void stream_textures_async(std::vector<std::pair<std::string_view, std::string_view>> textures);
+
         GLuint num_loaded_textures = 0;
         GLuint num_uploaded_textures = 0;
+
+        // CPU time spent uploading textures per frame, in milliseconds
+        static float texture_upload_budget;
+
+        // Estimated GPU memory used by textures, in bytes. Upgrades that
+        // would take it past the cap are discarded.
+        static GLsizeiptr texture_memory;
+        static GLsizeiptr texture_memory_cap;
+
+        // Sky color near the horizon, found when loading the sky cubemap
+        glm::vec4 fog_color = glm::vec4(1.0f);
 };
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+// Thread that creates and fills buffers and textures in a context shared
+// with the window, so that sending large resources to the driver does not
+// hold up the frames drawn meanwhile. Work is run in the order it was
+// submitted. Each job waits for a fence placed by the render thread when it
+// was submitted, so objects created before can be used by the job, and the
+// render thread is handed the results once a fence placed after the job
+// is signaled.
+// Vertex arrays and framebuffers are not shared between contexts, they are
+// always created by the render thread.
+class GpuLoader {
+    public:
+        // Creates a hidden window sharing the context of the given one and
+        // starts the thread. If the window can't be created the loader stays
+        // stopped and the callers do the work themselves.
+        static void start(GLFWwindow* window);
+
+        // Finishes the running job, discarding the others
+        static void stop();
+
+        static bool is_running();
+
+        // Whether any submitted job has not had its completion run yet
+        static bool has_pending_work();
+
+        // Runs the work on the loader thread. The completion runs on the
+        // render thread, during end_frame(), once the GPU is done with the
+        // commands of the work.
+        static void submit(std::function<void()> work, std::function<void()> completion = nullptr);
+
+        // Waits until all submitted work has run, and makes the next commands
+        // of the render thread wait for it on the GPU. Used before replacing
+        // an object the loader may still be writing to.
+        static void wait_idle();
+
+        // Runs the completions of finished jobs, should be called once at the
+        // end of every frame
+        static void end_frame();
+
+    private:
+        struct Job {
+            std::function<void()> work;
+            std::function<void()> completion;
+            GLsync fence;
+        };
+
+        static GLFWwindow* shared_window;
+        static std::thread thread;
+
+        static std::mutex mutex;
+        static std::condition_variable job_submitted;
+        static std::condition_variable job_finished;
+
+        static std::deque<Job> jobs;
+        static std::deque<Job> finished_jobs;
+        static bool busy;
+        static bool stopping;
+
+        static void run();
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <glad/gl.h>
+
+// Frames whose queries may be waiting for results at once
+#define GPU_TIMER_FRAMES 4
+
+// Scopes timed per frame, further ones are not timed
+#define GPU_TIMER_MAX_SCOPES 32
+
+// Named scopes of a frame timed on the GPU. Each scope is bounded by two
+// GL_TIMESTAMP queries, which unlike GL_TIME_ELAPSED can be issued while the
+// scene target times the whole scene. Results are read GPU_TIMER_FRAMES - 1
+// frames later, when they are already available, so reading never stalls.
+// Scopes are not nested: starting one ends the previous. Scopes sharing a
+// name in the same frame are summed.
+class GpuTimer {
+    public:
+        static void begin(std::string_view name);
+        static void end();
+
+        // Should be called once at the end of every frame, after its last draw
+        static void end_frame();
+
+        struct ScopeTime {
+            std::string name;
+            float milliseconds;
+        };
+
+        // Smoothed GPU time of every scope seen so far, in the order they
+        // were first timed
+        static const std::vector<ScopeTime>& get_times();
+
+        // Writes the times of every frame read back to a CSV file, one row
+        // per scope. The file is overwritten. Returns false if the file can't
+        // be opened.
+        static bool open_csv(const char* path);
+
+        // Closes the CSV file, if one is open
+        static void close_csv();
+
+    private:
+        struct Frame {
+            std::array<GLuint, 2 * GPU_TIMER_MAX_SCOPES> queries = {};
+            std::array<size_t, GPU_TIMER_MAX_SCOPES> scopes = {};
+            int num_scopes = 0;
+            bool pending = false;
+        };
+
+        static std::array<Frame, GPU_TIMER_FRAMES> frames;
+        static size_t frame;
+        static bool created;
+
+        // Whether the current frame is timed, and its scope is open
+        static bool timing;
+        static bool scope_open;
+
+        static std::vector<ScopeTime> times;
+        static unsigned long frames_read;
+        static FILE* csv_file;
+
+        static void create();
+
+        // Index of the scope in the times, added on first use
+        static size_t find_scope(std::string_view name);
+
+        static void read_results();
+};
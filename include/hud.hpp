@@ -2,11 +2,14 @@
 
 #include <memory>
 #include <string_view>
+#include <vector>
 
 #include <GLFW/glfw3.h>
 
 #include "camera.hpp"
 #include "input.hpp"
+#include "scene_target.hpp"
+#include "textrendering.hpp"
 
 #define BORDER_MARGIN (0.025)
 
@@ -15,6 +18,34 @@
 #define HUD_START (-1.0f + BORDER_MARGIN)
 #define HUD_END (1.0f - BORDER_MARGIN)
 
+// Text whose geometry is kept in GPU memory. It is laid out again only when
+// its text, position or scale change, or when the window is resized.
+class Label {
+    public:
+        Label(glm::vec2 pos = glm::vec2(0.0f), std::string text = "", float scale=1.0f);
+        ~Label();
+
+        Label(const Label&) = delete;
+        Label& operator=(const Label&) = delete;
+
+        void draw();
+
+        void set_text(std::string text);
+        void set_position(glm::vec2 pos);
+        void set_scale(float scale);
+
+        const std::string& get_text() const;
+
+    private:
+        glm::vec2 pos;
+        std::string text;
+        float scale;
+
+        TextGeometry geometry;
+        bool dirty = true;
+        unsigned int window_size_version = 0;
+};
+
 class Button {
     public:
         Button(GLFWwindow *window,
@@ -38,9 +69,14 @@ class Button {
         glm::vec2 pos_start;
         glm::vec2 pos_end;
 
-        std::string text;
+        float scale = 0.0f;
 
-        float scale;
+        Label label;
+
+        // Bounds depend on the window size, through the line height, and are
+        // computed again when it changes
+        unsigned int window_size_version = 0;
+        void update_bounds();
 };
 
 class Hud {
@@ -50,7 +86,11 @@ class Hud {
         void toggle_debug_info(bool boolean);
         void toggle_debug_info();
 
-        void update(glm::vec2 cursor, glm::vec4 cursor_intersection);
+        // Target whose resolution scale is shown in the debug info
+        void set_scene_target(const SceneTarget* scene_target);
+
+        // Returns whether any of the debug info shown changed
+        bool update(glm::vec2 cursor, glm::vec4 cursor_intersection);
         void draw();
 
     private:
@@ -63,15 +103,44 @@ class Hud {
 
         GLFWwindow* window;
 
-        float fps;
-        float frametime;
+        float fps = 0.0f;
+        float frametime = 0.0f;
 
         glm::vec2 cursor_pos;
         glm::vec4 cursor_intersection;
 
         std::shared_ptr<Camera> *camera;
 
+        const SceneTarget* scene_target = nullptr;
+
+        // Lines of the debug info, in the order they are listed in debug_labels
+        enum DebugLine {
+            DEBUG_GPU,
+            DEBUG_OPENGL,
+            DEBUG_FPS,
+            DEBUG_FRAMETIME,
+            DEBUG_GL_CALLS,
+            DEBUG_RESOLUTION,
+            DEBUG_GPU_SCOPES,
+            DEBUG_CAMERA,
+            DEBUG_CULLING,
+            DEBUG_TRIANGLES,
+            DEBUG_CURSOR,
+            DEBUG_INTERSECTION,
+            DEBUG_PROJECTION,
+            DEBUG_LINE_COUNT
+        };
+
+        std::vector<std::unique_ptr<Label>> debug_labels;
+
+        float values_update_time = 0.0f;
+
         void render_debug_info();
+        void layout_debug_info();
+
+        // Counts a drawn frame, returns true when new timings were computed
+        bool update_timings();
 
-        void update_timings();
+        void update_timing_labels();
+        void update_value_labels();
 };
@@ -43,6 +43,10 @@ class InputManager {
         bool get_is_enabled();
         void set_is_enabled(bool boolean);
 
+        // Whether anything changed since the last update, or a managed key,
+        // button or gamepad control is held. Should be called before update().
+        bool has_activity();
+
         // Should be called every frame after processing input
         void update();
 
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+// Quadric error metric simplification (Garland, Heckbert. Surface
+// Simplification Using Quadric Error Metrics, 1997), restricted to half-edge
+// collapses: an edge is always collapsed into one of its endpoints, so that
+// the simplified meshes can index the original vertex buffer.
+//
+// corner_positions holds the position of each triangle corner, 3 per triangle.
+// Locked positions are never removed, they should be used for texture and
+// normal seams.
+//
+// Returns one index buffer per target triangle count, sorted from the finest
+// to the coarsest. Indices refer to the corners of the original mesh, whose
+// attributes are used by the simplified triangle.
+std::vector<std::vector<uint32_t>> simplify_mesh(const std::vector<glm::vec3>& positions,
+                                                 const std::vector<uint32_t>& corner_positions,
+                                                 const std::vector<bool>& locked,
+                                                 std::vector<size_t> target_triangle_counts);
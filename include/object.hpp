@@ -1,19 +1,62 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <string>
-#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
 #include <glad/gl.h>
 #include <tiny_obj_loader.h>
 
+#include <glm/mat3x3.hpp>
 #include <glm/mat4x4.hpp>
 
 #include "gpu.hpp"
 #include "matrices.hpp"
 #include "collisions.hpp"
+#include "geometry_pool.hpp"
+#include "stream_buffer.hpp"
+#include "render_queue.hpp"
+
+// Levels of detail generated for each model, including the full mesh
+#define MAX_LODS 4
+
+// Models with fewer triangles are always drawn at full resolution
+#define LOD_MIN_TRIANGLES 500
+
+// Range of the index buffer used by a level of detail
+struct MeshLod {
+    GLuint first_index;
+    GLsizei num_indices;
+};
+
+// Vertex data of a model with its own buffers, one per attribute, kept on
+// the CPU until it is sent to the GPU
+struct ModelGeometry {
+    std::vector<float>  model_coefficients;
+    std::vector<float>  normal_coefficients;
+    std::vector<float>  texture_coefficients;
+    std::vector<float>  tangent_coefficients;
+    std::vector<GLuint> indices;
+
+    // Filled by the upload, zero for attributes the model does not have
+    std::array<GLuint, 4> attribute_buffer_ids = {};
+    GLuint indices_id = 0;
+};
+
+// View data used while collecting objects for drawing
+struct ViewInfo {
+    Frustum frustum;
+    glm::vec4 camera_position;
+
+    // Converts the radius of a sphere to a fraction of half the screen
+    // height, after division by its distance in perspective projection
+    float projection_scale;
+    bool perspective;
+};
 
 class ObjModel {
     public:
@@ -30,12 +73,47 @@ class ObjModel {
         void compute_normals();
 
         void build_triangles();
-        void draw(GpuProgram& gpu_program);
+
+        // Generates coarser levels of detail by quadric error edge collapse,
+        // stored after the full mesh in the same index buffer
+        void build_lods();
+
+        // Sends the geometry to the GPU, on the loader thread when it is
+        // running. The model is drawn only once it is uploaded.
+        void upload_geometry();
+
+        void draw(GpuProgram& gpu_program, GLuint instance_vbo_id,
+                  GLint first_instance, GLsizei num_instances, size_t lod = 0);
+
+        // Per-instance attributes of a VAO, read from an instance buffer.
+        // Without direct state access the VAO must be bound.
+        static void enable_instance_attributes(GLuint vao_id);
+        static void set_instance_buffer(GLuint vao_id, GLuint instance_vbo_id, size_t offset);
 
         void print_info();
 
         size_t num_indices;
-        GLuint vao_id;
+        GLuint vao_id = 0;
+        GLuint indices_id = 0;
+
+        // Position of the vertices in the geometry pool, when it is used
+        GLint base_vertex = 0;
+
+        // From the full mesh to the coarsest level
+        std::vector<MeshLod> lods;
+
+        bool uploaded = false;
+
+    private:
+        // Released once uploaded, unused with the geometry pool
+        std::shared_ptr<ModelGeometry> geometry;
+
+        // Expires with the model, so that an upload finishing later does not
+        // touch it
+        std::shared_ptr<bool> lifetime = std::make_shared<bool>(true);
+
+        static void create_buffers(ModelGeometry& geometry);
+        void create_vertex_array();
 };
 
 class Object {
@@ -56,16 +134,84 @@ class Object {
 
         void set_uniform(std::string_view name, UniformValue value);
         void apply_uniforms();
-        
-        void draw(glm::mat4 parent_transform = Matrix_Identity());
+
+        void set_render_pass(RenderPass pass);
+
+        // Adds this object and its children to the render queue
+        // Only instances that intersect the frustum are drawn, each with the
+        // level of detail chosen from its size on the screen
+        void collect(RenderQueue& queue,
+                     const ViewInfo& view,
+                     glm::mat4 parent_transform = Matrix_Identity());
+
+        // Draws all active instances, called by the render queue
+        void draw_instances(bool apply_uniforms);
+
+        // Draws the same instances with a program that only writes depth
+        void draw_depth(GpuProgram& depth_program);
+
+        // Appends one indirect draw per level of detail, to be drawn from the
+        // geometry pool. The base instance of the commands is relative to the
+        // start of the instance buffer.
+        void append_draw_commands(std::vector<DrawElementsIndirectCommand>& commands) const;
+
+        // Stream buffer holding the instances written this frame
+        GLuint get_instance_buffer() const;
+
+        GpuProgram& get_gpu_program() const;
+        bool has_same_uniforms(const Object& other) const;
+
+        struct RenderStats {
+            // Issued to OpenGL, one multi-draw counting as one call
+            GLuint draw_calls = 0;
+            GLuint instances_drawn = 0;
+            GLuint instances_culled = 0;
+            GLuint triangles_drawn = 0;
+            GLuint triangles_without_lod = 0;
+        };
+
+        // Counted while collecting and drawing, for all objects
+        static RenderStats render_stats;
+        static RenderStats render_stats_last_frame;
+
+        static bool frustum_culling;
+
+        // Should be called once at the end of every frame
+        static void end_frame();
 
     private:
-        std::unordered_map<std::string, UniformValue> uniforms;
+        // Uniform values, addressed by the program uniform handles
+        std::vector<std::pair<GLint, UniformValue>> uniforms;
         GpuProgram& gpu_program;
 
+        // Small hash of the uniform values, used to group draws with the same material
+        uint16_t material = 0;
+        void update_material();
+
+        RenderPass render_pass = RenderPass::OPAQUE;
+
         std::vector<glm::mat4> transforms;
         size_t num_instances = 0;
         std::vector<bool> inactive_instances;
 
+        // Level of detail of each instance, kept between frames for hysteresis
+        std::vector<uint8_t> instance_lods;
+
+        // Transforms of the visible instances, grouped by level of detail.
+        // They are computed when marked dirty or when the parent transform or
+        // the set of visible instances changes, and written to the stream
+        // buffer on every frame the object is drawn.
+        std::vector<InstanceData> instance_data;
+        StreamAllocation instance_allocation;
+        GLsizei num_visible_instances = 0;
+        bool instances_dirty = true;
+        glm::mat4 computed_parent_transform;
+
+        std::array<std::vector<GLuint>, MAX_LODS> visible_instances;
+        std::array<std::vector<GLuint>, MAX_LODS> computed_instances;
+
+        void compute_instances(glm::mat4 parent_transform);
+        void draw_lods(GpuProgram& program);
+
         std::vector<std::shared_ptr<Object>> children;
 };
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <glad/gl.h>
+
+// Directory of the cached program binaries, relative to the executable
+#define PROGRAM_CACHE_DIRECTORY "../../cache/programs/"
+
+// On-disk cache of linked GPU programs, so that shaders are only compiled
+// the first time a given source runs on a given driver
+class ProgramCache {
+    public:
+        // Removes all cached binaries, so that startup runs with a cold cache
+        static void clear();
+
+        // Identifies a program by its final sources, which include any
+        // injected definitions, and by the driver that compiles them
+        static uint64_t key(const std::string& vertex_source, const std::string& fragment_source);
+
+        // Loads a cached binary into a newly created program. Returns false
+        // when there is no binary or the driver rejects it.
+        static bool load(uint64_t key, GLuint program_id);
+
+        // Saves the binary of a program linked with the retrievable hint
+        static void store(uint64_t key, GLuint program_id);
+
+        // Prints how programs were built so far and how long it took
+        static void print_stats();
+
+        static GLuint hits;
+        static GLuint misses;
+        static GLuint rejected;
+        static double build_seconds;
+
+    private:
+        static std::string path(uint64_t key);
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "geometry_pool.hpp"
+#include "stream_buffer.hpp"
+
+class Object;
+class GpuProgram;
+
+// Passes are submitted in this order
+enum class RenderPass : uint8_t {
+    BACKGROUND = 0,  // No depth test, drawn behind everything else
+    OPAQUE     = 1,
+    BACKDROP   = 2,  // Drawn at the far plane, only where nothing else was drawn
+    BLENDED    = 3,  // Alpha blending, drawn back to front
+};
+
+// How the sky and the opaque geometry of a frame are drawn
+enum class RenderMode : uint8_t {
+    SKY_FIRST,      // Sky cube in the background pass, everything drawn over it
+    SKY_LAST,       // Fullscreen sky after opaque geometry, shading only uncovered pixels
+    DEPTH_PREPASS,  // As SKY_LAST, with the depth of opaque geometry laid down first,
+                    // so that each visible pixel is shaded only once
+};
+
+struct DrawItem {
+    uint64_t key;
+
+    // Fullscreen draws have a program and no object
+    Object* object;
+    GpuProgram* program;
+};
+
+// Collects the draws of a frame and submits them sorted by state
+class RenderQueue {
+    public:
+        void clear();
+
+        void push(RenderPass pass, GLuint program_id, GLuint vao_id,
+                  uint16_t material, float depth, Object* object);
+
+        // Queues a triangle covering the whole screen, positioned by the
+        // vertex shader of the program from gl_VertexID
+        void push_fullscreen(RenderPass pass, GpuProgram& program);
+
+        // Opaque items are first drawn with this program and color writes
+        // disabled, then shaded with depth test GL_LEQUAL. Null disables it.
+        void set_depth_prepass(GpuProgram* depth_program);
+
+        // Sorts the items by key and draws them. With the geometry pool,
+        // consecutive opaque items sharing a program and uniform values are
+        // drawn by a single glMultiDrawElementsIndirect.
+        void submit();
+
+        size_t size();
+
+        // Builds a 64-bit sort key, from most to least significant bits:
+        //   opaque:  pass (2) | program (8) | VAO (12) | material (16) | depth (26)
+        //   blended: pass (2) | inverted depth (26) | program (8) | VAO (12) | material (16)
+        // Depth is the distance to the camera, normalized to [0, 1]
+        static uint64_t make_key(RenderPass pass, GLuint program_id, GLuint vao_id,
+                                 uint16_t material, float depth);
+
+        static RenderPass get_pass(uint64_t key);
+
+    private:
+        std::vector<DrawItem> items;
+
+        GpuProgram* depth_prepass_program = nullptr;
+
+        // Fullscreen draws have no vertex attributes, but a VAO must be bound
+        GLuint empty_vao_id = 0;
+
+        // Range of opaque items drawn by one multi-draw, and of their commands
+        // Their instances are read from the stream buffer through the base
+        // instance of each command.
+        struct MultiDrawBatch {
+            size_t first_item;
+            size_t num_items;
+            size_t first_command;
+            GLsizei num_commands;
+            GLuint instance_buffer_id;
+        };
+
+        std::vector<MultiDrawBatch> batches;
+        std::vector<DrawElementsIndirectCommand> commands;
+
+        // Written to the stream buffer every frame
+        StreamAllocation command_allocation;
+
+        void set_pass_state(RenderPass pass);
+        void draw_depth_prepass();
+
+        void build_batches();
+        void draw_batch(const MultiDrawBatch& batch, GpuProgram& program);
+};
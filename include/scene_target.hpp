@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/vec2.hpp>
+
+#include "gpu.hpp"
+
+// Timer queries in flight, their results are read a few frames later
+#define SCENE_TIMER_QUERIES 4
+
+// Texture unit read by the FXAA pass
+#define FXAA_TEXTURE_UNIT 30
+
+enum class AntiAliasing : uint8_t {
+    NONE,
+    MSAA_2X,
+    MSAA_4X,
+    MSAA_8X,
+    FXAA,     // Single post-process pass over the scene drawn without samples
+    COUNT,
+};
+
+// Name shown in the menu and in the debug info
+const char* anti_aliasing_name(AntiAliasing mode);
+
+// Offscreen target where the 3D scene is drawn at a fraction of the window
+// resolution. The fraction follows the GPU time spent on the scene, and the
+// image is scaled to the window size before the HUD is drawn over it.
+// Edges are smoothed by multisampling the target or by an FXAA pass.
+class SceneTarget {
+    public:
+        SceneTarget();
+        ~SceneTarget();
+
+        SceneTarget(const SceneTarget&) = delete;
+        SceneTarget& operator=(const SceneTarget&) = delete;
+
+        // Binds the target, with the viewport set to the scaled size
+        void begin(GLFWwindow* window);
+
+        // Resolves the scene into the window framebuffer and binds it again
+        void end();
+
+        float get_scale() const;
+        glm::ivec2 get_size() const;
+        glm::ivec2 get_window_size() const;
+
+        // Average GPU time of the scene in milliseconds, 0 until measured
+        float get_gpu_time() const;
+
+        AntiAliasing get_anti_aliasing() const;
+
+        // Samples actually allocated, which GL_MAX_SAMPLES may limit below
+        // those of the chosen mode, and the mode described with them
+        GLsizei get_samples() const;
+        std::string get_anti_aliasing_description() const;
+
+        // With a fixed scale the scene is always drawn at the maximum scale
+        void set_dynamic_scale(bool dynamic);
+
+        // GPU time of every measured frame, summed since the last reset
+        void reset_measurements();
+        double get_measured_gpu_time() const;
+        GLuint get_measured_frames() const;
+
+        // Range of the scale and GPU time it aims for, set from the command line
+        static float min_scale;
+        static float max_scale;
+        static float target_gpu_time;
+
+        // Chosen in the menu, applied by every target on its next frame
+        static AntiAliasing anti_aliasing;
+
+    private:
+        GLuint scene_fbo_id = 0;
+        GLuint color_rbo_id = 0;
+        GLuint depth_rbo_id = 0;
+
+        // Without samples the scene is drawn to a texture, read by the FXAA pass
+        GLuint color_texture_id = 0;
+
+        // Multisampled images can only be scaled after being resolved
+        GLuint resolve_fbo_id = 0;
+        GLuint resolve_rbo_id = 0;
+
+        AntiAliasing allocated_anti_aliasing = AntiAliasing::COUNT;
+        GLsizei samples = 0;
+        GLint max_samples = 0;
+
+        std::unique_ptr<GpuProgram> fxaa_program;
+        GLuint empty_vao_id = 0;
+
+        // Size of the window framebuffer and of the allocated images, which
+        // fit the maximum scale so that scale changes never reallocate them
+        glm::ivec2 window_size = glm::ivec2(0);
+        glm::ivec2 allocated_size = glm::ivec2(0);
+
+        float scale = 1.0f;
+        glm::ivec2 size = glm::ivec2(0);
+
+        std::array<GLuint, SCENE_TIMER_QUERIES> queries = {};
+        std::array<bool, SCENE_TIMER_QUERIES> query_pending = {};
+        std::array<bool, SCENE_TIMER_QUERIES> query_stale = {};
+        int next_query = 0;
+        bool timing = false;
+
+        float gpu_time = 0.0f;
+        int samples_since_change = 0;
+        bool dynamic_scale = true;
+
+        double measured_gpu_time = 0.0;
+        GLuint measured_frames = 0;
+
+        void allocate();
+        void release();
+
+        void resolve();
+        void apply_fxaa();
+
+        void read_timer_queries();
+        void update_scale(float frame_gpu_time);
+};
@@ -34,6 +34,7 @@ class GameStateManager {
         std::vector<std::unique_ptr<GameState>> states;
         std::shared_ptr<Window> window;
         std::shared_ptr<GpuProgram> gpu_program;
+        bool redraw_requested = true;
 
     public:
         GameStateManager(std::shared_ptr<Window> w,
@@ -50,4 +51,10 @@ class GameStateManager {
         GameState* current_state();
 
         bool empty();
+
+        // States request a redraw when something on screen changed, so that
+        // frames can be skipped while nothing does. Consuming the request
+        // clears it.
+        void request_redraw();
+        bool consume_redraw_request();
 };
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <utility>
+#include <string>
 #include <unordered_map>
 
 #include <glm/vec4.hpp>
@@ -15,6 +16,7 @@
 #include "input.hpp"
 #include "state.hpp"
 #include "animation.hpp"
+#include "scene_target.hpp"
 
 class PieceTracker {
     private:
@@ -109,6 +111,18 @@ class GameplayState: public GameState {
         std::unique_ptr<InputManager> input;
 
         std::unique_ptr<Hud> hud;
+        std::unique_ptr<Label> end_message;
+
+        std::unique_ptr<UniformBuffer> frame_uniforms;
+
+        std::unique_ptr<SceneTarget> scene_target;
+
+        RenderQueue render_queue;
+        RenderMode render_mode = RenderMode::SKY_LAST;
+
+        // Sky drawn as a fullscreen triangle and opaque geometry drawn depth only
+        GpuProgram* sky_fullscreen_program = nullptr;
+        GpuProgram* depth_program = nullptr;
 
         std::unique_ptr<ChessGame> chess_game;
 
@@ -153,6 +167,51 @@ class GameplayState: public GameState {
         AnimationCubicBezier piece_animation;
         AnimationCamera camera_animation;
 
+        // Fixed camera path, run once without and once with frustum culling
+        // to measure the draw calls saved by it
+        struct CullingBenchmark {
+            bool running = false;
+            int pass = 0;
+            float time = 0.0f;
+
+            unsigned long frames[2] = {};
+            unsigned long draw_calls[2] = {};
+            unsigned long instances[2] = {};
+            float seconds[2] = {};
+
+            // The benchmark flies its own free camera, the user's is put back
+            // afterwards
+            std::shared_ptr<Camera> previous_camera;
+            std::shared_ptr<FreeCamera> previous_free_camera;
+        } culling_benchmark;
+
+        void start_culling_benchmark();
+        void update_culling_benchmark(float delta_t);
+
+        // Same camera path, run once for each anti-aliasing mode at a fixed
+        // resolution scale, to compare their cost
+        struct AntiAliasingBenchmark {
+            bool running = false;
+            int mode = 0;
+            float time = 0.0f;
+
+            unsigned long frames[int(AntiAliasing::COUNT)] = {};
+            float seconds[int(AntiAliasing::COUNT)] = {};
+            double gpu_milliseconds[int(AntiAliasing::COUNT)] = {};
+            unsigned long gpu_frames[int(AntiAliasing::COUNT)] = {};
+            std::string descriptions[int(AntiAliasing::COUNT)];
+
+            AntiAliasing previous_mode = AntiAliasing::NONE;
+            std::shared_ptr<Camera> previous_camera;
+            std::shared_ptr<FreeCamera> previous_free_camera;
+        } anti_aliasing_benchmark;
+
+        void start_anti_aliasing_benchmark();
+        void update_anti_aliasing_benchmark(float delta_t);
+
+        // Goes around the table, looking at the board and away from it
+        void move_benchmark_camera(float fraction);
+
         void process_inputs(float delta_t);
         void update_chess_game(float delta_t);
         void update_3D_piece(chess::Move move, chess::Piece piece, float new_x, float new_y, float new_z);
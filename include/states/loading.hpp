@@ -1,6 +1,9 @@
 #pragma once
 
+#include <memory>
+
 #include "state.hpp"
+#include "hud.hpp"
 
 enum TEXTURE_QUALITY {
     LOW = 0,
@@ -21,4 +24,9 @@ class LoadingState: public GameState {
         TEXTURE_QUALITY texture_quality;
 
         bool loading_complete = false;
+
+        std::unique_ptr<Label> progress_label;
+
+        // Progress text is only formatted again when a texture level is uploaded
+        float shown_progress = -1.0f;
 };
@@ -4,6 +4,7 @@
 #include "state.hpp"
 #include "input.hpp"
 #include "hud.hpp"
+#include "scene_target.hpp"
 
 class MenuState: public GameState {
     public:
@@ -18,6 +19,11 @@ class MenuState: public GameState {
 
         std::unique_ptr<Button> play_button;
         std::unique_ptr<Button> texture_quality_button;
+        std::unique_ptr<Button> anti_aliasing_button;
+
+        std::unique_ptr<Label> title_label;
+        std::unique_ptr<Label> texture_quality_label;
+        std::unique_ptr<Label> anti_aliasing_label;
 
         TEXTURE_QUALITY texture_quality;
 };
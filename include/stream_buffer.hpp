@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <glad/gl.h>
+
+// Frames the GPU may still be reading from when the CPU writes a new one
+#define STREAM_FRAMES_IN_FLIGHT 3
+
+// Initial space of each frame, which doubles when a frame does not fit
+#define STREAM_INITIAL_FRAME_SIZE (1 << 20)
+
+// Range of the stream buffer holding data written in the current frame
+struct StreamAllocation {
+    GLuint buffer_id = 0;
+    GLintptr offset = 0;
+};
+
+// Ring buffer for data written by the CPU every frame and read by the GPU
+// in the same frame, such as text vertices, instance matrices and uniforms.
+// Each frame in flight owns a region of the buffer, so writes never touch
+// memory the GPU may still be reading and never wait for the driver.
+// With GL_ARB_buffer_storage the buffer stays mapped and each region is
+// protected by a fence; on OpenGL 3.3 the storage is orphaned whenever the
+// ring wraps around.
+class StreamBuffer {
+    public:
+        // Copies the data into the region of the current frame, at an offset
+        // that is a multiple of the alignment. The allocation is valid until
+        // the end of the frame.
+        static StreamAllocation write(const void* data, GLsizeiptr size, GLsizeiptr alignment = 4);
+
+        // Should be called once at the end of every frame, after its last draw
+        static void end_frame();
+
+        // Bytes written in the last frame, and times the CPU had to wait for
+        // the GPU to release a region
+        static GLsizeiptr bytes_written_last_frame;
+        static GLuint stalls;
+
+    private:
+        static GLuint buffer_id;
+        static char* mapped_data;
+        static bool persistent;
+
+        static GLsizeiptr frame_size;
+        static GLsizeiptr frame_offset;
+        static size_t frame;
+
+        static std::array<GLsync, STREAM_FRAMES_IN_FLIGHT> fences;
+
+        // Buffers replaced while growing, deleted once the GPU is done with them
+        struct RetiredBuffer {
+            GLuint buffer_id;
+            size_t frames_left;
+        };
+        static std::vector<RetiredBuffer> retired_buffers;
+
+        static void create();
+        static void grow(GLsizeiptr required_size);
+        static void wait_for_region();
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 #include <GLFW/glfw3.h>
@@ -9,7 +10,9 @@
 
 // Declaração de funções auxiliares para renderizar texto dentro da janela
 // OpenGL. Estas funções estão definidas no arquivo "textrendering.cpp".
-void TextRendering_Init();
+void TextRendering_Init(GLFWwindow* window);
+void TextRendering_UpdateWindowSize(GLFWwindow* window);
+void TextRendering_Flush();
 float TextRendering_LineHeight(GLFWwindow* window);
 float TextRendering_CharWidth(GLFWwindow* window);
 void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f);
@@ -18,3 +21,21 @@ void TextRendering_PrintVector(GLFWwindow* window, glm::vec4 v, float x, float y
 void TextRendering_PrintMatrixVectorProduct(GLFWwindow* window, glm::mat4 M, glm::vec4 v, float x, float y, float scale = 1.0f);
 void TextRendering_PrintMatrixVectorProductMoreDigits(GLFWwindow* window, glm::mat4 M, glm::vec4 v, float x, float y, float scale = 1.0f);
 void TextRendering_PrintMatrixVectorProductDivW(GLFWwindow* window, glm::mat4 M, glm::vec4 v, float x, float y, float scale = 1.0f);
+
+// Quads of a string kept in GPU memory, for text that does not change every
+// frame. Queued geometries are drawn together with the printed strings by
+// TextRendering_Flush().
+struct TextGeometry {
+    unsigned int vao = 0;
+    unsigned int vbo = 0;
+    int num_vertices = 0;
+    std::ptrdiff_t capacity = 0;
+};
+
+void TextRendering_BuildGeometry(TextGeometry &geometry, const std::string &str, float x, float y, float scale = 1.0f);
+void TextRendering_DrawGeometry(const TextGeometry &geometry);
+void TextRendering_DeleteGeometry(TextGeometry &geometry);
+
+// Incremented whenever the window is resized, so that retained geometry
+// knows when it has to be laid out again
+unsigned int TextRendering_WindowSizeVersion();
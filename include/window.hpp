@@ -23,11 +23,19 @@ class Window {
 
         void maximize();
 
+        static bool damaged;
+
+        static void refresh_callback(GLFWwindow *window);
+        static void iconify_callback(GLFWwindow *window, int iconified);
+
     public:
         Window(const char* title, int width=DEFAULT_WIDTH, int height=DEFAULT_HEIGHT);
 
         GLFWwindow *glfw_window;
 
+        // Asks for an OpenGL 4.5 context before falling back to 3.3
+        static bool request_direct_state_access;
+
         void resize(int width, int height, int x, int y);
 
         glm::vec2 get_size();
@@ -40,6 +48,14 @@ class Window {
 
         void set_framebuffer_size_callback(void callback(GLFWwindow *, int, int));
 
+        // Minimized or hidden, nothing drawn would be seen
+        bool is_suspended();
+
+        // Whether the window contents were lost or resized since the last
+        // call, and must be drawn again even if the scene did not change
+        bool consume_damage();
+        static void mark_damaged();
+
         void toggle_cursor();
         void toggle_cursor(bool boolean);
         bool is_cursor_enabled();
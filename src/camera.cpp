@@ -53,6 +53,15 @@ glm::mat4 Camera::get_projection_matrix()
     return projection;
 }
 
+float Camera::get_projection_scale()
+{
+    if (use_perspective_projection)
+        return 1.0f / tan(fov / 2.0f);
+
+    // Same projection plane size used by get_projection_matrix()
+    return log2(orthographic_zoom) / 1.5f;
+}
+
 void Camera::adjust_angles(float ti, float pi)
 {
     set_angles(theta + ti, phi + pi);
@@ -1,3 +1,5 @@
+#include <cmath>
+
 #include <glm/vec4.hpp>
 #include <glm/vec2.hpp>
 #include <glm/mat4x4.hpp>
@@ -118,3 +120,51 @@ bool aabb_aabb_intersection(glm::vec4 pos1,
     return collision_x && collision_y && collision_z;
     // return collision.x && collision.y && collision.z;
 }
+
+AABB transform_aabb(const AABB& aabb, const glm::mat4& m)
+{
+    // Método de Arvo: cada eixo da matriz contribui para a extensão da caixa
+    // de acordo com o valor absoluto de seus coeficientes
+    glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+    glm::vec3 extent = (aabb.max - aabb.min) * 0.5f;
+
+    glm::vec3 new_center = glm::vec3(m * glm::vec4(center, 1.0f));
+    glm::vec3 new_extent(0.0f);
+
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            new_extent[i] += std::abs(m[j][i]) * extent[j];
+
+    return AABB(new_center - new_extent, new_center + new_extent);
+}
+
+// Gribb, Hartmann. Fast Extraction of Viewing Frustum Planes from the
+// World-View-Projection Matrix
+Frustum::Frustum(const glm::mat4& m)
+{
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++)
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+    planes[0] = row[3] + row[0];    // Esquerda
+    planes[1] = row[3] - row[0];    // Direita
+    planes[2] = row[3] + row[1];    // Baixo
+    planes[3] = row[3] - row[1];    // Cima
+    planes[4] = row[3] + row[2];    // Perto
+    planes[5] = row[3] - row[2];    // Longe
+}
+
+bool Frustum::intersects(const AABB& aabb) const
+{
+    for (const auto& plane : planes) {
+        // Vértice da caixa mais à frente na direção da normal do plano
+        glm::vec3 p(plane.x >= 0.0f ? aabb.max.x : aabb.min.x,
+                    plane.y >= 0.0f ? aabb.max.y : aabb.min.y,
+                    plane.z >= 0.0f ? aabb.max.z : aabb.min.z);
+
+        if (plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w < 0.0f)
+            return false;
+    }
+
+    return true;
+}
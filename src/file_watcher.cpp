@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "file_watcher.hpp"
+
+// Time without changes after which a burst of writes is considered finished
+#define FILE_WATCHER_SETTLE_TIME std::chrono::milliseconds(100)
+
+FileWatcher::FileWatcher(std::vector<std::string> p)
+{
+    for (const auto& path : p)
+        paths.push_back(std::filesystem::absolute(path).lexically_normal());
+
+#ifdef __linux__
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1) {
+        std::cerr << "FileWatcher: inotify unavailable, files will not be watched" << std::endl;
+        return;
+    }
+
+    // Directories are watched instead of files, since many editors save by
+    // replacing the file, which would end a watch on the file itself
+    std::vector<std::filesystem::path> directories;
+    for (const auto& path : paths)
+        if (std::find(directories.begin(), directories.end(), path.parent_path()) == directories.end())
+            directories.push_back(path.parent_path());
+
+    for (const auto& directory : directories) {
+        int wd = inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd != -1)
+            watch_descriptors.push_back(wd);
+    }
+#else
+    for (const auto& path : paths) {
+        std::error_code error;
+        write_times.push_back(std::filesystem::last_write_time(path, error));
+    }
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    if (inotify_fd != -1)
+        close(inotify_fd);
+#endif
+}
+
+bool FileWatcher::poll()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if (read_changes()) {
+        changed = true;
+        last_change = now;
+    }
+
+    if (changed && now - last_change >= FILE_WATCHER_SETTLE_TIME) {
+        changed = false;
+        return true;
+    }
+
+    return false;
+}
+
+#ifdef __linux__
+bool FileWatcher::read_changes()
+{
+    if (inotify_fd == -1)
+        return false;
+
+    bool any_change = false;
+
+    alignas(struct inotify_event) char buffer[4096];
+
+    // The descriptor is non-blocking, read fails with EAGAIN once the queue is empty
+    ssize_t length;
+    while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + length; ) {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->len == 0)
+                continue;
+
+            for (const auto& path : paths)
+                if (path.filename() == event->name)
+                    any_change = true;
+        }
+    }
+
+    return any_change;
+}
+#else
+bool FileWatcher::read_changes()
+{
+    bool any_change = false;
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::error_code error;
+        auto write_time = std::filesystem::last_write_time(paths[i], error);
+
+        if (!error && write_time != write_times[i]) {
+            write_times[i] = write_time;
+            any_change = true;
+        }
+    }
+
+    return any_change;
+}
+#endif
@@ -0,0 +1,228 @@
+#include <cstddef>
+#include <memory>
+
+#include <glad/gl.h>
+
+#include "geometry_pool.hpp"
+#include "gl_extensions.hpp"
+#include "gl_state.hpp"
+#include "gpu_loader.hpp"
+#include "object.hpp"
+
+// Initial size of the buffers, which double when full
+#define INITIAL_VERTEX_CAPACITY (1 << 16)
+#define INITIAL_INDEX_CAPACITY (1 << 18)
+
+GLuint GeometryPool::vao_id = 0;
+GLuint GeometryPool::vertex_buffer_id = 0;
+GLuint GeometryPool::index_buffer_id = 0;
+
+GLsizeiptr GeometryPool::num_vertices = 0;
+GLsizeiptr GeometryPool::vertex_capacity = 0;
+GLsizeiptr GeometryPool::num_indices = 0;
+GLsizeiptr GeometryPool::index_capacity = 0;
+
+bool GeometryPool::is_enabled()
+{
+    return GlExtensions::multi_draw_indirect;
+}
+
+// Buffer with room for the given size, filled later by parts
+static GLuint create_buffer(GLenum target, GLsizeiptr size)
+{
+    GLuint buffer_id;
+
+    if (GlExtensions::direct_state_access) {
+        glCreateBuffers(1, &buffer_id);
+        glNamedBufferStorage(buffer_id, size, NULL, GL_DYNAMIC_STORAGE_BIT);
+        return buffer_id;
+    }
+
+    glGenBuffers(1, &buffer_id);
+    GlState::bind_buffer(target, buffer_id);
+    glBufferData(target, size, NULL, GL_STATIC_DRAW);
+    return buffer_id;
+}
+
+void GeometryPool::create()
+{
+    vertex_capacity = INITIAL_VERTEX_CAPACITY;
+    index_capacity = INITIAL_INDEX_CAPACITY;
+
+    if (GlExtensions::direct_state_access) {
+        glCreateVertexArrays(1, &vao_id);
+
+        vertex_buffer_id = create_buffer(GL_ARRAY_BUFFER, vertex_capacity * sizeof(PoolVertex));
+        index_buffer_id = create_buffer(GL_ELEMENT_ARRAY_BUFFER, index_capacity * sizeof(GLuint));
+        set_vertex_attributes();
+        glVertexArrayElementBuffer(vao_id, index_buffer_id);
+
+        ObjModel::enable_instance_attributes(vao_id);
+        return;
+    }
+
+    glGenVertexArrays(1, &vao_id);
+    GlState::bind_vertex_array(vao_id);
+
+    vertex_buffer_id = create_buffer(GL_ARRAY_BUFFER, vertex_capacity * sizeof(PoolVertex));
+    set_vertex_attributes();
+
+    // The element buffer binding is part of the VAO state
+    index_buffer_id = create_buffer(GL_ELEMENT_ARRAY_BUFFER, index_capacity * sizeof(GLuint));
+
+    ObjModel::enable_instance_attributes(vao_id);
+
+    GlState::bind_vertex_array(0);
+}
+
+void GeometryPool::set_vertex_attributes()
+{
+    // Every attribute is read from binding 0, which points to the vertex buffer
+    if (GlExtensions::direct_state_access) {
+        glVertexArrayVertexBuffer(vao_id, 0, vertex_buffer_id, 0, sizeof(PoolVertex));
+
+        glVertexArrayAttribFormat(vao_id, 0, 4, GL_FLOAT, GL_FALSE, offsetof(PoolVertex, position));
+        glVertexArrayAttribFormat(vao_id, 1, 4, GL_FLOAT, GL_FALSE, offsetof(PoolVertex, normal));
+        glVertexArrayAttribFormat(vao_id, 2, 2, GL_FLOAT, GL_FALSE, offsetof(PoolVertex, texcoords));
+        glVertexArrayAttribFormat(vao_id, 3, 4, GL_FLOAT, GL_FALSE, offsetof(PoolVertex, tangent));
+
+        for (GLuint location = 0; location < 4; location++) {
+            glVertexArrayAttribBinding(vao_id, location, 0);
+            glEnableVertexArrayAttrib(vao_id, location);
+        }
+        return;
+    }
+
+    // Called with the VAO and the vertex buffer bound
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(PoolVertex), (void*)offsetof(PoolVertex, position));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(PoolVertex), (void*)offsetof(PoolVertex, normal));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PoolVertex), (void*)offsetof(PoolVertex, texcoords));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(PoolVertex), (void*)offsetof(PoolVertex, tangent));
+
+    for (GLuint location = 0; location < 4; location++)
+        glEnableVertexAttribArray(location);
+}
+
+GLuint GeometryPool::grow(GLuint buffer_id, GLsizeiptr used_size, GLsizeiptr& capacity, GLsizeiptr required_size)
+{
+    while (capacity < required_size)
+        capacity *= 2;
+
+    GLuint new_buffer_id = create_buffer(GL_COPY_WRITE_BUFFER, capacity);
+
+    if (GlExtensions::direct_state_access) {
+        glCopyNamedBufferSubData(buffer_id, new_buffer_id, 0, 0, used_size);
+        GlState::forget_buffer(buffer_id);
+        glDeleteBuffers(1, &buffer_id);
+        return new_buffer_id;
+    }
+
+    GlState::bind_buffer(GL_COPY_READ_BUFFER, buffer_id);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used_size);
+
+    GlState::bind_buffer(GL_COPY_READ_BUFFER, 0);
+    GlState::bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // The buffer may still be cached as bound to its usual target, and the
+    // next buffer created can reuse its name
+    GlState::forget_buffer(buffer_id);
+    glDeleteBuffers(1, &buffer_id);
+
+    return new_buffer_id;
+}
+
+void GeometryPool::write(GLuint buffer_id, GLintptr offset, GLsizeiptr size, const void* data)
+{
+    // The copy target is not part of the VAO state, so the write does not
+    // depend on the VAO bound in the context it runs on
+    auto write_data = [buffer_id, offset, size](const void* data) {
+        if (GlExtensions::direct_state_access) {
+            glNamedBufferSubData(buffer_id, offset, size, data);
+            return;
+        }
+
+        GlState::bind_buffer(GL_COPY_WRITE_BUFFER, buffer_id);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+        GlState::bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+    };
+
+    if (!GpuLoader::is_running()) {
+        write_data(data);
+        return;
+    }
+
+    // The loader thread writes from its own copy of the data
+    auto copy = std::make_shared<std::vector<char>>((const char*)data, (const char*)data + size);
+    GpuLoader::submit([write_data, copy]() { write_data(copy->data()); });
+}
+
+GLint GeometryPool::add_vertices(const std::vector<PoolVertex>& vertices)
+{
+    if (vao_id == 0)
+        create();
+
+    if (num_vertices + GLsizeiptr(vertices.size()) > vertex_capacity) {
+        // The loader may still be writing to the buffer being replaced
+        GpuLoader::wait_idle();
+
+        GLsizeiptr capacity = vertex_capacity * sizeof(PoolVertex);
+        vertex_buffer_id = grow(vertex_buffer_id, num_vertices * sizeof(PoolVertex), capacity,
+                                (num_vertices + vertices.size()) * sizeof(PoolVertex));
+        vertex_capacity = capacity / sizeof(PoolVertex);
+
+        bool bind = !GlExtensions::direct_state_access;
+        if (bind) {
+            GlState::bind_vertex_array(vao_id);
+            GlState::bind_buffer(GL_ARRAY_BUFFER, vertex_buffer_id);
+        }
+        set_vertex_attributes();
+        if (bind)
+            GlState::bind_vertex_array(0);
+    }
+
+    write(vertex_buffer_id, num_vertices * sizeof(PoolVertex),
+          vertices.size() * sizeof(PoolVertex), vertices.data());
+
+    GLint base_vertex = num_vertices;
+    num_vertices += vertices.size();
+    return base_vertex;
+}
+
+GLuint GeometryPool::add_indices(const std::vector<GLuint>& indices)
+{
+    if (vao_id == 0)
+        create();
+
+    if (num_indices + GLsizeiptr(indices.size()) > index_capacity) {
+        GpuLoader::wait_idle();
+
+        GLsizeiptr capacity = index_capacity * sizeof(GLuint);
+        index_buffer_id = grow(index_buffer_id, num_indices * sizeof(GLuint), capacity,
+                               (num_indices + indices.size()) * sizeof(GLuint));
+        index_capacity = capacity / sizeof(GLuint);
+
+        // The element buffer binding is part of the VAO state
+        if (GlExtensions::direct_state_access) {
+            glVertexArrayElementBuffer(vao_id, index_buffer_id);
+        }
+        else {
+            GlState::bind_vertex_array(vao_id);
+            GlState::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_id);
+            GlState::bind_vertex_array(0);
+        }
+    }
+
+    write(index_buffer_id, num_indices * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+
+    GLuint first_index = num_indices;
+    num_indices += indices.size();
+    return first_index;
+}
+
+GLuint GeometryPool::get_vao()
+{
+    if (vao_id == 0)
+        create();
+
+    return vao_id;
+}
@@ -0,0 +1,145 @@
+#include <cstring>
+
+#include <glad/gl.h>
+
+#include "gl_extensions.hpp"
+
+PFNGLGETPROGRAMBINARYPROC glad_glGetProgramBinary = NULL;
+PFNGLPROGRAMBINARYPROC glad_glProgramBinary = NULL;
+PFNGLPROGRAMPARAMETERIPROC glad_glProgramParameteri = NULL;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR = NULL;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glad_glMultiDrawElementsIndirect = NULL;
+PFNGLBUFFERSTORAGEPROC glad_glBufferStorage = NULL;
+PFNGLCREATEBUFFERSPROC glad_glCreateBuffers = NULL;
+PFNGLNAMEDBUFFERSTORAGEPROC glad_glNamedBufferStorage = NULL;
+PFNGLNAMEDBUFFERDATAPROC glad_glNamedBufferData = NULL;
+PFNGLNAMEDBUFFERSUBDATAPROC glad_glNamedBufferSubData = NULL;
+PFNGLCOPYNAMEDBUFFERSUBDATAPROC glad_glCopyNamedBufferSubData = NULL;
+PFNGLCREATEVERTEXARRAYSPROC glad_glCreateVertexArrays = NULL;
+PFNGLENABLEVERTEXARRAYATTRIBPROC glad_glEnableVertexArrayAttrib = NULL;
+PFNGLVERTEXARRAYATTRIBFORMATPROC glad_glVertexArrayAttribFormat = NULL;
+PFNGLVERTEXARRAYATTRIBBINDINGPROC glad_glVertexArrayAttribBinding = NULL;
+PFNGLVERTEXARRAYBINDINGDIVISORPROC glad_glVertexArrayBindingDivisor = NULL;
+PFNGLVERTEXARRAYVERTEXBUFFERPROC glad_glVertexArrayVertexBuffer = NULL;
+PFNGLVERTEXARRAYELEMENTBUFFERPROC glad_glVertexArrayElementBuffer = NULL;
+PFNGLCREATETEXTURESPROC glad_glCreateTextures = NULL;
+PFNGLTEXTURESTORAGE2DPROC glad_glTextureStorage2D = NULL;
+PFNGLTEXTURESTORAGE3DPROC glad_glTextureStorage3D = NULL;
+PFNGLTEXTURESUBIMAGE2DPROC glad_glTextureSubImage2D = NULL;
+PFNGLTEXTURESUBIMAGE3DPROC glad_glTextureSubImage3D = NULL;
+PFNGLTEXTUREPARAMETERIPROC glad_glTextureParameteri = NULL;
+PFNGLBINDTEXTUREUNITPROC glad_glBindTextureUnit = NULL;
+
+bool GlExtensions::program_binary = false;
+bool GlExtensions::parallel_shader_compile = false;
+bool GlExtensions::multi_draw_indirect = false;
+bool GlExtensions::buffer_storage = false;
+bool GlExtensions::direct_state_access = false;
+
+void GlExtensions::load(GLADloadfunc load)
+{
+    if (has_version(4, 1) || has_extension("GL_ARB_get_program_binary")) {
+        glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+
+        // Drivers may expose the functions without supporting any format
+        GLint num_formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+
+        program_binary = glad_glGetProgramBinary && glad_glProgramBinary &&
+                         glad_glProgramParameteri && num_formats > 0;
+    }
+
+    if (has_extension("GL_KHR_parallel_shader_compile")) {
+        glad_glMaxShaderCompilerThreadsKHR =
+            (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+
+        parallel_shader_compile = glad_glMaxShaderCompilerThreadsKHR != NULL;
+
+        // Lets the driver pick the number of compiler threads
+        if (parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    }
+
+    if (has_version(4, 3) || (has_extension("GL_ARB_multi_draw_indirect") &&
+                              has_extension("GL_ARB_base_instance"))) {
+        glad_glMultiDrawElementsIndirect =
+            (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+
+        multi_draw_indirect = glad_glMultiDrawElementsIndirect != NULL;
+    }
+
+    if (has_version(4, 4) || has_extension("GL_ARB_buffer_storage")) {
+        glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+
+        buffer_storage = glad_glBufferStorage != NULL;
+    }
+
+    if (has_version(4, 5) || (has_extension("GL_ARB_direct_state_access") &&
+                              has_extension("GL_ARB_texture_storage") && buffer_storage)) {
+        glad_glCreateBuffers = (PFNGLCREATEBUFFERSPROC)load("glCreateBuffers");
+        glad_glNamedBufferStorage = (PFNGLNAMEDBUFFERSTORAGEPROC)load("glNamedBufferStorage");
+        glad_glNamedBufferData = (PFNGLNAMEDBUFFERDATAPROC)load("glNamedBufferData");
+        glad_glNamedBufferSubData = (PFNGLNAMEDBUFFERSUBDATAPROC)load("glNamedBufferSubData");
+        glad_glCopyNamedBufferSubData = (PFNGLCOPYNAMEDBUFFERSUBDATAPROC)load("glCopyNamedBufferSubData");
+        glad_glCreateVertexArrays = (PFNGLCREATEVERTEXARRAYSPROC)load("glCreateVertexArrays");
+        glad_glEnableVertexArrayAttrib = (PFNGLENABLEVERTEXARRAYATTRIBPROC)load("glEnableVertexArrayAttrib");
+        glad_glVertexArrayAttribFormat = (PFNGLVERTEXARRAYATTRIBFORMATPROC)load("glVertexArrayAttribFormat");
+        glad_glVertexArrayAttribBinding = (PFNGLVERTEXARRAYATTRIBBINDINGPROC)load("glVertexArrayAttribBinding");
+        glad_glVertexArrayBindingDivisor = (PFNGLVERTEXARRAYBINDINGDIVISORPROC)load("glVertexArrayBindingDivisor");
+        glad_glVertexArrayVertexBuffer = (PFNGLVERTEXARRAYVERTEXBUFFERPROC)load("glVertexArrayVertexBuffer");
+        glad_glVertexArrayElementBuffer = (PFNGLVERTEXARRAYELEMENTBUFFERPROC)load("glVertexArrayElementBuffer");
+        glad_glCreateTextures = (PFNGLCREATETEXTURESPROC)load("glCreateTextures");
+        glad_glTextureStorage2D = (PFNGLTEXTURESTORAGE2DPROC)load("glTextureStorage2D");
+        glad_glTextureStorage3D = (PFNGLTEXTURESTORAGE3DPROC)load("glTextureStorage3D");
+        glad_glTextureSubImage2D = (PFNGLTEXTURESUBIMAGE2DPROC)load("glTextureSubImage2D");
+        glad_glTextureSubImage3D = (PFNGLTEXTURESUBIMAGE3DPROC)load("glTextureSubImage3D");
+        glad_glTextureParameteri = (PFNGLTEXTUREPARAMETERIPROC)load("glTextureParameteri");
+        glad_glBindTextureUnit = (PFNGLBINDTEXTUREUNITPROC)load("glBindTextureUnit");
+
+        direct_state_access = glad_glCreateBuffers &&
+                              glad_glNamedBufferStorage &&
+                              glad_glNamedBufferData &&
+                              glad_glNamedBufferSubData &&
+                              glad_glCopyNamedBufferSubData &&
+                              glad_glCreateVertexArrays &&
+                              glad_glEnableVertexArrayAttrib &&
+                              glad_glVertexArrayAttribFormat &&
+                              glad_glVertexArrayAttribBinding &&
+                              glad_glVertexArrayBindingDivisor &&
+                              glad_glVertexArrayVertexBuffer &&
+                              glad_glVertexArrayElementBuffer &&
+                              glad_glCreateTextures &&
+                              glad_glTextureStorage2D &&
+                              glad_glTextureStorage3D &&
+                              glad_glTextureSubImage2D &&
+                              glad_glTextureSubImage3D &&
+                              glad_glTextureParameteri &&
+                              glad_glBindTextureUnit;
+    }
+}
+
+bool GlExtensions::has_version(GLint major, GLint minor)
+{
+    GLint context_major = 0;
+    GLint context_minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &context_major);
+    glGetIntegerv(GL_MINOR_VERSION, &context_minor);
+
+    return context_major > major || (context_major == major && context_minor >= minor);
+}
+
+bool GlExtensions::has_extension(const char* name)
+{
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+
+    for (GLint i = 0; i < num_extensions; i++) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+
+    return false;
+}
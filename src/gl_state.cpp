@@ -0,0 +1,224 @@
+#include <glad/gl.h>
+
+#include "gl_extensions.hpp"
+#include "gl_state.hpp"
+
+thread_local GLuint GlState::changes_issued = 0;
+thread_local GLuint GlState::changes_filtered = 0;
+thread_local GLuint GlState::changes_issued_last_frame = 0;
+thread_local GLuint GlState::changes_filtered_last_frame = 0;
+
+thread_local std::unordered_map<GLenum, bool> GlState::capabilities;
+thread_local std::unordered_map<GLenum, GLuint> GlState::buffers;
+thread_local std::unordered_map<GLuint, GLuint> GlState::samplers;
+thread_local std::unordered_map<GLuint64, GLuint> GlState::textures;
+
+thread_local GLuint GlState::blend_source = 0;
+thread_local GLuint GlState::blend_destination = 0;
+thread_local GLuint GlState::depth_function = 0;
+thread_local GLuint GlState::depth_write = 0;
+thread_local GLuint GlState::color_write = 0;
+thread_local GLuint GlState::polygon_fill_mode = 0;
+thread_local GLuint GlState::program = 0;
+thread_local GLuint GlState::vertex_array = 0;
+thread_local GLuint GlState::texture_unit = 0;
+
+// Nothing is known about the context until the first call of each kind
+thread_local bool GlState::blend_known = false;
+thread_local bool GlState::depth_function_known = false;
+thread_local bool GlState::depth_write_known = false;
+thread_local bool GlState::color_write_known = false;
+thread_local bool GlState::polygon_fill_mode_known = false;
+thread_local bool GlState::program_known = false;
+thread_local bool GlState::vertex_array_known = false;
+thread_local bool GlState::texture_unit_known = false;
+
+template<typename K, typename V>
+bool GlState::update(std::unordered_map<K, V>& cache, K key, V value)
+{
+    auto it = cache.find(key);
+    if (it != cache.end() && it->second == value) {
+        changes_filtered++;
+        return false;
+    }
+
+    cache[key] = value;
+    changes_issued++;
+    return true;
+}
+
+bool GlState::update(GLuint& cache, bool& known, GLuint value)
+{
+    if (known && cache == value) {
+        changes_filtered++;
+        return false;
+    }
+
+    cache = value;
+    known = true;
+    changes_issued++;
+    return true;
+}
+
+void GlState::enable(GLenum capability)
+{
+    set_enabled(capability, true);
+}
+
+void GlState::disable(GLenum capability)
+{
+    set_enabled(capability, false);
+}
+
+void GlState::set_enabled(GLenum capability, bool enabled)
+{
+    if (!update(capabilities, capability, enabled))
+        return;
+
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void GlState::blend_func(GLenum source_factor, GLenum destination_factor)
+{
+    if (blend_known && blend_source == source_factor && blend_destination == destination_factor) {
+        changes_filtered++;
+        return;
+    }
+
+    blend_source = source_factor;
+    blend_destination = destination_factor;
+    blend_known = true;
+    changes_issued++;
+
+    glBlendFunc(source_factor, destination_factor);
+}
+
+void GlState::depth_func(GLenum func)
+{
+    if (update(depth_function, depth_function_known, func))
+        glDepthFunc(func);
+}
+
+void GlState::depth_mask(GLboolean mask)
+{
+    if (update(depth_write, depth_write_known, mask))
+        glDepthMask(mask);
+}
+
+void GlState::color_mask(GLboolean mask)
+{
+    if (update(color_write, color_write_known, mask))
+        glColorMask(mask, mask, mask, mask);
+}
+
+void GlState::polygon_mode(GLenum mode)
+{
+    if (update(polygon_fill_mode, polygon_fill_mode_known, mode))
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void GlState::use_program(GLuint program_id)
+{
+    if (update(program, program_known, program_id))
+        glUseProgram(program_id);
+}
+
+void GlState::bind_vertex_array(GLuint vao_id)
+{
+    if (update(vertex_array, vertex_array_known, vao_id))
+        glBindVertexArray(vao_id);
+}
+
+void GlState::bind_buffer(GLenum target, GLuint buffer_id)
+{
+    if (target == GL_ELEMENT_ARRAY_BUFFER) {
+        changes_issued++;
+        glBindBuffer(target, buffer_id);
+        return;
+    }
+
+    if (update(buffers, target, buffer_id))
+        glBindBuffer(target, buffer_id);
+}
+
+void GlState::bind_buffer_base(GLenum target, GLuint index, GLuint buffer_id)
+{
+    // Indexed bindings also change the generic binding of the target
+    buffers[target] = buffer_id;
+    changes_issued++;
+
+    glBindBufferBase(target, index, buffer_id);
+}
+
+void GlState::bind_buffer_range(GLenum target, GLuint index, GLuint buffer_id,
+                                GLintptr offset, GLsizeiptr size)
+{
+    buffers[target] = buffer_id;
+    changes_issued++;
+
+    glBindBufferRange(target, index, buffer_id, offset, size);
+}
+
+void GlState::active_texture(GLuint unit)
+{
+    if (update(texture_unit, texture_unit_known, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GlState::bind_texture(GLuint unit, GLenum target, GLuint texture_id)
+{
+    GLuint64 key = (GLuint64(unit) << 32) | target;
+
+    if (!GlExtensions::direct_state_access)
+        active_texture(unit);
+
+    if (!update(textures, key, texture_id))
+        return;
+
+    // Binding 0 by unit would unbind every target of the unit
+    if (GlExtensions::direct_state_access && texture_id != 0) {
+        glBindTextureUnit(unit, texture_id);
+        return;
+    }
+
+    active_texture(unit);
+    glBindTexture(target, texture_id);
+}
+
+void GlState::bind_sampler(GLuint unit, GLuint sampler_id)
+{
+    if (update(samplers, unit, sampler_id))
+        glBindSampler(unit, sampler_id);
+}
+
+void GlState::forget_program(GLuint program_id)
+{
+    // Deleting the bound program only takes effect once it is unbound,
+    // the next use_program() must reach the driver
+    if (program_known && program == program_id)
+        program_known = false;
+}
+
+void GlState::forget_buffer(GLuint buffer_id)
+{
+    for (auto& [target, bound_id] : buffers)
+        if (bound_id == buffer_id)
+            bound_id = 0;
+}
+
+void GlState::forget_vertex_array(GLuint vao_id)
+{
+    if (vertex_array_known && vertex_array == vao_id)
+        vertex_array = 0;
+}
+
+void GlState::end_frame()
+{
+    changes_issued_last_frame = changes_issued;
+    changes_filtered_last_frame = changes_filtered;
+    changes_issued = 0;
+    changes_filtered = 0;
+}
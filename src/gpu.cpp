@@ -1,6 +1,13 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <optional>
 #include <ostream>
 #include <string_view>
 #include <string>
+#include <tuple>
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -13,9 +20,43 @@
 #include <stb_image.h>
 
 #include "gpu.hpp"
+#include "gl_state.hpp"
+#include "gl_extensions.hpp"
+#include "program_cache.hpp"
+#include "file_watcher.hpp"
+#include "gpu_loader.hpp"
+#include "stream_buffer.hpp"
+
+UniformBuffer::UniformBuffer(GLuint b)
+{
+    binding = b;
+}
 
-GpuProgram::GpuProgram(std::string_view v_path, std::string_view f_path)
+void UniformBuffer::update(const void* data, GLsizeiptr size)
 {
+    // Offsets of uniform ranges must follow the alignment of the driver
+    static GLint alignment = 0;
+    if (alignment == 0)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    StreamAllocation allocation = StreamBuffer::write(data, size, alignment);
+    GlState::bind_buffer_range(GL_UNIFORM_BUFFER, binding, allocation.buffer_id, allocation.offset, size);
+}
+
+GLuint GpuProgram::upload_pbo_id = 0;
+GLuint GpuProgram::array_sampler_id = 0;
+float GpuProgram::texture_upload_budget = 4.0f;
+
+GLsizeiptr GpuProgram::texture_memory = 0;
+GLsizeiptr GpuProgram::texture_memory_cap = GLsizeiptr(1024) << 20;
+
+GLuint GpuProgram::gl_calls_avoided = 0;
+GLuint GpuProgram::gl_calls_avoided_last_frame = 0;
+GLuint GpuProgram::failed_reloads = 0;
+
+GpuProgram::GpuProgram(std::string_view v_path, std::string_view f_path, std::vector<std::string> d)
+{
+    defines = std::move(d);
     load_shaders_from_files(v_path, f_path);
 }
 
@@ -27,98 +68,421 @@ GpuProgram::GpuProgram(const GLchar* const vertex_shader_source,
 
 void GpuProgram::reload_shaders()
 {
-    load_shaders_from_files("../../src/shader_vertex.glsl", "../../src/shader_fragment.glsl");
+    reloading = true;
+    start_reload();
+
+    for (auto& [key, permutation] : permutations)
+        permutation->reload_shaders();
+}
+
+void GpuProgram::watch_shader_files()
+{
+    shader_watcher = std::make_unique<FileWatcher>(
+        std::vector<std::string>{vertex_shader_path, fragment_shader_path});
+}
+
+bool GpuProgram::update_reload()
+{
+    if (shader_watcher && shader_watcher->poll())
+        reload_shaders();
+
+    if (!reloading)
+        return false;
+
+    poll_reload();
+
+    // Reloads done by the loader thread finish between two calls
+    if (!is_reload_pending()) {
+        if (failed_reloads == 0)
+            std::cout << "Shaders recarregados!" << std::endl;
+
+        failed_reloads = 0;
+        reloading = false;
+    }
+
+    return true;
+}
+
+bool GpuProgram::is_reload_pending() const
+{
+    if (pending_program)
+        return true;
+
+    for (const auto& [key, permutation] : permutations)
+        if (permutation->is_reload_pending())
+            return true;
+
+    return false;
+}
+
+// Inicia a compilação dos shaders em segundo plano. O programa atual
+// continua sendo usado até que o novo seja linkado com sucesso.
+void GpuProgram::start_reload()
+{
+    // Um novo reload substitui aquele que ainda estiver compilando
+    discard_pending_reload();
+
+    std::optional<std::string> vertex_source = read_shader_file(vertex_shader_path, defines);
+    std::optional<std::string> fragment_source = read_shader_file(fragment_shader_path, defines);
+
+    if (!vertex_source || !fragment_source)
+        return;
+
+    PendingProgram pending;
+    pending.cache_key = ProgramCache::key(*vertex_source, *fragment_source);
+    pending.id = glCreateProgram();
+
+    if (!ProgramCache::load(pending.cache_key, pending.id)) {
+        glDeleteProgram(pending.id);
+
+        std::string defines_info;
+        for (const auto& define : defines)
+            defines_info += "Define: " + define + "\n";
+
+        pending.vertex_log_info = "File: " + vertex_shader_path + "\n" + defines_info;
+        pending.fragment_log_info = "File: " + fragment_shader_path + "\n" + defines_info;
+
+        // Checking the result would wait for the driver, so it is left to
+        // the loader thread when the driver can't tell it is done
+        if (!GlExtensions::parallel_shader_compile && GpuLoader::is_running()) {
+            start_loader_reload(std::move(pending), std::move(*vertex_source), std::move(*fragment_source));
+            return;
+        }
+
+        pending.vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
+        pending.fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+
+        compile_shader(pending.vertex_shader_id, *vertex_source);
+        compile_shader(pending.fragment_shader_id, *fragment_source);
+
+        pending.id = link_program(pending.vertex_shader_id, pending.fragment_shader_id);
+    }
+
+    pending_program = std::move(pending);
+}
+
+// Compila e linka o programa na thread de carregamento, onde esperar pelo
+// driver não atrasa os quadros. O programa substitui o atual quando a thread
+// principal recebe o resultado.
+void GpuProgram::start_loader_reload(PendingProgram pending,
+                                     std::string vertex_source,
+                                     std::string fragment_source)
+{
+    auto result = std::make_shared<GLuint>(0);
+    pending.loader_program = result;
+
+    GpuLoader::submit([result, vertex_source = std::move(vertex_source),
+                       fragment_source = std::move(fragment_source),
+                       vertex_log_info = pending.vertex_log_info,
+                       fragment_log_info = pending.fragment_log_info]() {
+            GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
+            GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+
+            compile_shader(vertex_shader_id, vertex_source);
+            compile_shader(fragment_shader_id, fragment_source);
+
+            bool vertex_ok = check_shader(vertex_shader_id, vertex_log_info);
+            bool fragment_ok = check_shader(fragment_shader_id, fragment_log_info);
+
+            GLuint program_id = link_program(vertex_shader_id, fragment_shader_id);
+            bool linked_ok = vertex_ok && fragment_ok && check_program(program_id);
+
+            release_shaders(program_id, vertex_shader_id, fragment_shader_id);
+
+            if (linked_ok)
+                *result = program_id;
+            else
+                glDeleteProgram(program_id);
+        },
+        [this, result]() {
+            // A reload started or discarded meanwhile no longer wants it
+            if (!pending_program || pending_program->loader_program != result) {
+                if (*result != 0)
+                    glDeleteProgram(*result);
+                return;
+            }
+
+            if (*result == 0) {
+                fprintf(stderr, "Erro ao recarregar shaders, o programa anterior foi mantido.\n");
+                failed_reloads++;
+                pending_program.reset();
+                return;
+            }
+
+            ProgramCache::store(pending_program->cache_key, *result);
+            replace_program(*result);
+        });
+
+    pending_program = std::move(pending);
+}
+
+void GpuProgram::poll_reload()
+{
+    if (pending_program)
+        finish_reload();
+
+    for (auto& [key, permutation] : permutations)
+        permutation->poll_reload();
+}
+
+void GpuProgram::finish_reload()
+{
+    PendingProgram& pending = *pending_program;
+
+    // The loader thread replaces the program once it is done
+    if (pending.loader_program)
+        return;
+
+    // Programs restored from the cache have no shaders and are already linked
+    bool from_cache = pending.vertex_shader_id == 0;
+
+    if (!from_cache) {
+        // Without KHR_parallel_shader_compile, querying the result waits
+        // for the driver, so it is only done a frame after linking started
+        if (GlExtensions::parallel_shader_compile) {
+            GLint completed = GL_FALSE;
+            glGetProgramiv(pending.id, GL_COMPLETION_STATUS_KHR, &completed);
+            if (completed == GL_FALSE)
+                return;
+        }
+        else if (pending.polls++ == 0) {
+            // Without the loader thread either, the check below blocks until
+            // the driver is done, so it waits a frame to block for less
+            return;
+        }
+
+        bool vertex_ok = check_shader(pending.vertex_shader_id, pending.vertex_log_info);
+        bool fragment_ok = check_shader(pending.fragment_shader_id, pending.fragment_log_info);
+        bool linked_ok = vertex_ok && fragment_ok && check_program(pending.id);
+
+        release_shaders(pending.id, pending.vertex_shader_id, pending.fragment_shader_id);
+
+        if (!linked_ok) {
+            fprintf(stderr, "Erro ao recarregar shaders, o programa anterior foi mantido.\n");
+            failed_reloads++;
+            glDeleteProgram(pending.id);
+            pending_program.reset();
+            return;
+        }
+
+        ProgramCache::store(pending.cache_key, pending.id);
+    }
+
+    replace_program(pending.id);
+}
+
+// Troca o programa somente após a linkagem ter sido bem sucedida
+void GpuProgram::replace_program(GLuint program_id)
+{
+    GlState::forget_program(id);
+    glDeleteProgram(id);
 
-    glUseProgram(id);
-    for (size_t i = 0; i < texture_uniforms.size(); i++)
-        glUniform1i(glGetUniformLocation(id, texture_uniforms[i].data()), i);
-    glUseProgram(0);
+    id = program_id;
+    pending_program.reset();
 
-    std::cout << "Shaders recarregados!" << std::endl;
+    setup_program();
+}
+
+void GpuProgram::discard_pending_reload()
+{
+    if (!pending_program)
+        return;
+
+    // The program of the loader thread is deleted when it is handed back
+    if (pending_program->loader_program) {
+        pending_program.reset();
+        return;
+    }
+
+    if (pending_program->vertex_shader_id != 0)
+        release_shaders(pending_program->id,
+                        pending_program->vertex_shader_id,
+                        pending_program->fragment_shader_id);
+
+    glDeleteProgram(pending_program->id);
+    pending_program.reset();
+}
+
+GpuProgram& GpuProgram::get_permutation(std::vector<std::string> d)
+{
+    // The order of the definitions does not matter
+    std::sort(d.begin(), d.end());
+
+    std::string key;
+    for (const auto& define : d)
+        key += define + "\n";
+
+    auto it = permutations.find(key);
+    if (it != permutations.end())
+        return *it->second;
+
+    std::vector<std::string> all_defines = defines;
+    all_defines.insert(all_defines.end(), d.begin(), d.end());
+
+    auto permutation = std::make_unique<GpuProgram>(vertex_shader_path, fragment_shader_path, all_defines);
+
+    for (const auto& [uniform, value] : texture_uniforms)
+        permutation->set_texture_uniform(uniform, value);
+
+    return *permutations.emplace(key, std::move(permutation)).first->second;
+}
+
+void GpuProgram::set_texture_uniform(std::string_view uniform, GLint value)
+{
+    set_uniform(uniform, (int)value);
+
+    auto it = std::find_if(texture_uniforms.begin(), texture_uniforms.end(),
+                           [uniform](const auto& entry) { return entry.first == uniform; });
+    if (it != texture_uniforms.end())
+        it->second = value;
+    else
+        texture_uniforms.emplace_back(uniform, value);
+
+    for (auto& [key, permutation] : permutations)
+        permutation->set_texture_uniform(uniform, value);
 }
 
 // Carrega shaders de arquivos e cria programa de GPU utilizando-os
 void GpuProgram::load_shaders_from_files(std::string_view v_path,
                                          std::string_view f_path)
 {
-    vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
-    fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+    vertex_shader_path = v_path;
+    fragment_shader_path = f_path;
 
-    // Carrega um Vertex Shader de um arquivo GLSL
-    load_shader_from_file(v_path, vertex_shader_id);
+    // Carrega o Vertex Shader e o Fragment Shader de arquivos GLSL
+    std::optional<std::string> vertex_source = read_shader_file(v_path, defines);
+    std::optional<std::string> fragment_source = read_shader_file(f_path, defines);
 
-    // Carrega um Fragment Shader de um arquivo GLSL
-    load_shader_from_file(f_path, fragment_shader_id);
+    if (!vertex_source || !fragment_source)
+        std::exit(EXIT_FAILURE);
 
-    // Deletamos o programa de GPU anterior, caso ele exista
-    if (id != 0)
-        glDeleteProgram(id);
+    std::string defines_info;
+    for (const auto& define : defines)
+        defines_info += "Define: " + define + "\n";
 
-    // Criamos um programa de GPU utilizando os shaders carregados acima
-    create_program();
+    build_program(*vertex_source, *fragment_source,
+                  "File: " + std::string(v_path) + "\n" + defines_info,
+                  "File: " + std::string(f_path) + "\n" + defines_info);
 }
 
-// Carrega shaders de arquivos e cria programa de GPU utilizando-os
+// Carrega shaders de strings e cria programa de GPU utilizando-os
 void GpuProgram::load_shaders_from_source(const GLchar* const vertex_shader_source,
                                           const GLchar* const fragment_shader_source)
 {
-    vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
-    fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Carrega um Vertex Shader de um arquivo GLSL
-    load_shader_from_source(vertex_shader_source, vertex_shader_id);
+    build_program(vertex_shader_source, fragment_shader_source, "", "");
+}
 
-    // Carrega um Fragment Shader de um arquivo GLSL
-    load_shader_from_source(fragment_shader_source, fragment_shader_id);
+// Cria o programa de GPU a partir do cache de binários ou, quando o cache
+// não possui o programa, compilando os shaders
+void GpuProgram::build_program(const std::string& vertex_source,
+                               const std::string& fragment_source,
+                               const std::string& vertex_log_info,
+                               const std::string& fragment_log_info)
+{
+    auto start = std::chrono::steady_clock::now();
 
     // Deletamos o programa de GPU anterior, caso ele exista
-    if (id != 0)
+    discard_pending_reload();
+    if (id != 0) {
+        GlState::forget_program(id);
         glDeleteProgram(id);
+    }
+
+    uint64_t cache_key = ProgramCache::key(vertex_source, fragment_source);
+
+    id = glCreateProgram();
+
+    if (!ProgramCache::load(cache_key, id)) {
+        // Um programa que rejeitou o binário não é reaproveitado
+        glDeleteProgram(id);
+
+        GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
+        GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+
+        compile_shader(vertex_shader_id, vertex_source);
+        compile_shader(fragment_shader_id, fragment_source);
+        check_shader(vertex_shader_id, vertex_log_info);
+        check_shader(fragment_shader_id, fragment_log_info);
+
+        // Criamos um programa de GPU utilizando os shaders carregados acima
+        id = link_program(vertex_shader_id, fragment_shader_id);
+        check_program(id);
+
+        release_shaders(id, vertex_shader_id, fragment_shader_id);
+
+        ProgramCache::store(cache_key, id);
+    }
+
+    setup_program();
 
-    // Criamos um programa de GPU utilizando os shaders carregados acima
-    create_program();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    ProgramCache::build_seconds += elapsed.count();
 }
 
-// Carrega shader de arquivo para shader_id
-void GpuProgram::load_shader_from_file(std::string_view filename, GLuint shader_id)
+// Prepara um programa recém linkado para ser usado
+void GpuProgram::setup_program()
+{
+    // Programs that use the per-frame data read it from a shared buffer
+    GLuint frame_uniforms_index = glGetUniformBlockIndex(id, "FrameUniforms");
+    if (frame_uniforms_index != GL_INVALID_INDEX)
+        glUniformBlockBinding(id, frame_uniforms_index, FRAME_UNIFORMS_BINDING);
+
+    reflect_uniforms();
+
+    for (const auto& [uniform, value] : texture_uniforms)
+        set_uniform(uniform, (int)value);
+}
+
+// Lê o código de um shader de um arquivo
+std::optional<std::string> GpuProgram::read_shader_file(std::string_view filename,
+                                                        const std::vector<std::string>& defines)
 {
     // Lemos o arquivo de texto indicado pela variável "filename"
-    // e colocamos seu conteúdo em memória, apontado pela variável
-    // "shader_string".
+    // e colocamos seu conteúdo em memória.
     std::ifstream file;
     try {
         file.exceptions(std::ifstream::failbit);
         file.open(std::string(filename).c_str());
     } catch (std::exception& e) {
-        std::cerr << "GpuProgram: Cannot open file" << filename << std::endl;
-        std::exit(EXIT_FAILURE);
+        std::cerr << "GpuProgram: Cannot open file " << filename << std::endl;
+        return std::nullopt;
     }
     std::stringstream shader;
     shader << file.rdbuf();
     std::string str = shader.str();
-    const GLchar* shader_string = str.c_str();
-    const GLint   shader_string_length = static_cast<GLint>(str.length());
 
-    std::string log_info = "File: " + std::string(filename) + "\n";
+    // As definições precisam vir logo após a diretiva #version. A diretiva
+    // #line mantém os números de linha dos erros iguais aos do arquivo.
+    if (!defines.empty()) {
+        size_t version_end = str.find('\n') + 1;
+
+        std::string preamble;
+        for (const auto& define : defines)
+            preamble += "#define " + define + "\n";
+        preamble += "#line 2\n";
+
+        str.insert(version_end, preamble);
+    }
 
-    load_shader_from_source(shader_string, shader_id, shader_string_length, log_info);
+    return str;
 }
 
-// Carrega shader de arquivo para shader_id
-void GpuProgram::load_shader_from_source(const GLchar* const shader_string,
-                                         GLuint shader_id,
-                                         int shader_string_length,
-                                         std::string log_info)
+// Envia o código do shader e inicia sua compilação, sem esperar pelo resultado
+void GpuProgram::compile_shader(GLuint shader_id, const std::string& source)
 {
+    const GLchar* shader_string = source.c_str();
+    const GLint   shader_string_length = static_cast<GLint>(source.length());
+
     // Define o código do shader GLSL, contido na string "shader_string"
-    if (shader_string_length == -1)
-        glShaderSource(shader_id, 1, &shader_string, NULL);
-    else
-        glShaderSource(shader_id, 1, &shader_string, &shader_string_length);
+    glShaderSource(shader_id, 1, &shader_string, &shader_string_length);
 
     // Compila o código do shader GLSL (em tempo de execução)
     glCompileShader(shader_id);
+}
 
+// Imprime o log de compilação do shader, retornando false em caso de erro
+bool GpuProgram::check_shader(GLuint shader_id, const std::string& log_info)
+{
     // Verificamos se ocorreu algum erro ou "warning" durante a compilação
     GLint compiled_ok;
     glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compiled_ok);
@@ -158,34 +522,47 @@ void GpuProgram::load_shader_from_source(const GLchar* const shader_string,
 
     // A chamada "delete" em C++ é equivalente ao "free()" do C
     delete [] log;
+
+    return compiled_ok == GL_TRUE;
 }
 
-void GpuProgram::create_program()
+// Inicia a linkagem de um programa com os shaders dados, sem esperar pelo resultado
+GLuint GpuProgram::link_program(GLuint vertex_shader_id, GLuint fragment_shader_id)
 {
     // Criamos um identificador (ID) para este programa de GPU
-    id = glCreateProgram();
+    GLuint program_id = glCreateProgram();
 
     // Definição dos dois shaders GLSL que devem ser executados pelo programa
-    glAttachShader(id, vertex_shader_id);
-    glAttachShader(id, fragment_shader_id);
+    glAttachShader(program_id, vertex_shader_id);
+    glAttachShader(program_id, fragment_shader_id);
+
+    // Permite salvar o binário do programa no cache
+    if (GlExtensions::program_binary)
+        glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
     // Linkagem dos shaders acima ao programa
-    glLinkProgram(id);
+    glLinkProgram(program_id);
 
+    return program_id;
+}
+
+// Imprime o log de linkagem do programa, retornando false em caso de erro
+bool GpuProgram::check_program(GLuint program_id)
+{
     // Verificamos se ocorreu algum erro durante a linkagem
     GLint linked_ok = GL_FALSE;
-    glGetProgramiv(id, GL_LINK_STATUS, &linked_ok);
+    glGetProgramiv(program_id, GL_LINK_STATUS, &linked_ok);
 
     // Imprime no terminal qualquer erro de linkagem
     if ( linked_ok == GL_FALSE )
     {
         GLint log_length = 0;
-        glGetProgramiv(id, GL_INFO_LOG_LENGTH, &log_length);
+        glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &log_length);
 
         // Alocamos memória para guardar o log de compilação
         GLchar* log = new GLchar[log_length];
 
-        glGetProgramInfoLog(id, log_length, &log_length, log);
+        glGetProgramInfoLog(program_id, log_length, &log_length, log);
 
         std::string output;
 
@@ -199,123 +576,399 @@ void GpuProgram::create_program()
 
         fprintf(stderr, "%s", output.c_str());
     }
+
+    return linked_ok == GL_TRUE;
+}
+
+// Os shaders não são mais necessários depois da linkagem
+void GpuProgram::release_shaders(GLuint program_id, GLuint vertex_shader_id, GLuint fragment_shader_id)
+{
+    glDetachShader(program_id, vertex_shader_id);
+    glDetachShader(program_id, fragment_shader_id);
+    glDeleteShader(vertex_shader_id);
+    glDeleteShader(fragment_shader_id);
+}
+
+// Fills the uniform table with all active uniforms of the linked program
+void GpuProgram::reflect_uniforms()
+{
+    // Uniforms from a previous link keep their handles, but their
+    // locations and cached values are no longer valid
+    for (auto& uniform : uniforms) {
+        uniform.location = -1;
+        uniform.has_value = false;
+    }
+
+    GLint num_uniforms = 0;
+    GLint max_name_length = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &num_uniforms);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+    std::vector<GLchar> name_buffer(max_name_length);
+
+    for (GLint i = 0; i < num_uniforms; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(id, i, max_name_length, &length, &size, &type, name_buffer.data());
+
+        std::string name(name_buffer.data(), length);
+
+        // Arrays are reported as "name[0]"
+        if (name.ends_with("[0]"))
+            name.resize(name.length() - 3);
+
+        // Uniforms inside uniform blocks have no location
+        GLint location = glGetUniformLocation(id, name.c_str());
+        if (location == -1)
+            continue;
+
+        UniformInfo& uniform = uniforms[get_uniform_handle(name)];
+        uniform.location = location;
+    }
+}
+
+void GpuProgram::use()
+{
+    use_program(id);
+}
+
+void GpuProgram::use_program(GLuint program_id)
+{
+    GlState::use_program(program_id);
+}
+
+void GpuProgram::end_frame()
+{
+    gl_calls_avoided_last_frame = gl_calls_avoided;
+    gl_calls_avoided = 0;
+}
+
+GLint GpuProgram::get_uniform_handle(std::string_view name)
+{
+    auto it = uniform_handles.find(name);
+    if (it != uniform_handles.end())
+        return it->second;
+
+    // Unknown uniforms get a handle without location, so that setting them
+    // is a no-op until a reload makes them active
+    GLint handle = uniforms.size();
+    uniforms.push_back(UniformInfo{std::string(name)});
+    uniform_handles.emplace(std::string(name), handle);
+
+    return handle;
+}
+
+GLint GpuProgram::get_uniform_location(std::string_view name)
+{
+    return uniforms[get_uniform_handle(name)].location;
+}
+
+bool GpuProgram::update_uniform_cache(GLint handle, const void* value, size_t size)
+{
+    UniformInfo& uniform = uniforms[handle];
+
+    // Inactive uniforms would not be uploaded anyway, so they are not counted
+    if (uniform.location == -1)
+        return false;
+
+    if (uniform.has_value && std::memcmp(uniform.value.data(), value, size) == 0) {
+        gl_calls_avoided++;
+        return false;
+    }
+
+    std::memcpy(uniform.value.data(), value, size);
+    uniform.has_value = true;
+
+    return true;
 }
 
 void GpuProgram::set_uniform(std::string_view name, float value)
 {
-    glUseProgram(id);
-    glUniform1f(get_uniform_location(name), value);
-    glUseProgram(0);
+    set_uniform(get_uniform_handle(name), value);
 }
 
 void GpuProgram::set_uniform(std::string_view name, int value)
 {
-    glUseProgram(id);
-    glUniform1i(get_uniform_location(name), value);
-    glUseProgram(0);
+    set_uniform(get_uniform_handle(name), value);
 }
 
 void GpuProgram::set_uniform(std::string_view name, glm::vec2 value)
 {
-    glUseProgram(id);
-    glUniform2fv(get_uniform_location(name), 1, glm::value_ptr(value));
-    glUseProgram(0);
+    set_uniform(get_uniform_handle(name), value);
 }
 
 void GpuProgram::set_uniform(std::string_view name, glm::vec4 value)
 {
-    glUseProgram(id);
-    glUniform4fv(get_uniform_location(name), 1, glm::value_ptr(value));
-    glUseProgram(0);
+    set_uniform(get_uniform_handle(name), value);
 }
 
 void GpuProgram::set_uniform(std::string_view name, glm::mat4 value)
 {
-    glUseProgram(id);
-    glUniformMatrix4fv(get_uniform_location(name), 1, GL_FALSE, glm::value_ptr(value));
-    glUseProgram(0);
+    set_uniform(get_uniform_handle(name), value);
 }
 
-GLint GpuProgram::get_uniform_location(std::string_view name)
+void GpuProgram::set_uniform(GLint handle, float value)
+{
+    if (!update_uniform_cache(handle, &value, sizeof(value)))
+        return;
+
+    use();
+    glUniform1f(uniforms[handle].location, value);
+}
+
+void GpuProgram::set_uniform(GLint handle, int value)
+{
+    if (!update_uniform_cache(handle, &value, sizeof(value)))
+        return;
+
+    use();
+    glUniform1i(uniforms[handle].location, value);
+}
+
+void GpuProgram::set_uniform(GLint handle, glm::vec2 value)
+{
+    if (!update_uniform_cache(handle, glm::value_ptr(value), sizeof(value)))
+        return;
+
+    use();
+    glUniform2fv(uniforms[handle].location, 1, glm::value_ptr(value));
+}
+
+void GpuProgram::set_uniform(GLint handle, glm::vec4 value)
+{
+    if (!update_uniform_cache(handle, glm::value_ptr(value), sizeof(value)))
+        return;
+
+    use();
+    glUniform4fv(uniforms[handle].location, 1, glm::value_ptr(value));
+}
+
+void GpuProgram::set_uniform(GLint handle, glm::mat4 value)
+{
+    if (!update_uniform_cache(handle, glm::value_ptr(value), sizeof(value)))
+        return;
+
+    use();
+    glUniformMatrix4fv(uniforms[handle].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+// Converte uma cor em ponto flutuante para o formato GL_RGB9_E5, com três
+// mantissas de 9 bits e um expoente compartilhado de 5 bits, seguindo a
+// especificação de GL_EXT_texture_shared_exponent. O expoente é lido
+// diretamente dos bits do maior componente, sem log2().
+static uint32_t color_to_rgb9e5(const float* rgb)
 {
-    return glGetUniformLocation(id, name.data());
+    // Maior valor representável, (2^9 - 1) / 2^9 * 2^16
+    const float max_value = 65408.0f;
+
+    float r = std::clamp(rgb[0], 0.0f, max_value);
+    float g = std::clamp(rgb[1], 0.0f, max_value);
+    float b = std::clamp(rgb[2], 0.0f, max_value);
+    float max_component = std::max(std::max(r, g), b);
+
+    // floor(log2(max_component)), limitado ao menor expoente do formato
+    int exponent = int(std::bit_cast<uint32_t>(max_component) >> 23) - 127;
+    int shared_exponent = std::max(exponent, -16) + 16;
+
+    // 2^(24 - shared_exponent), o inverso do valor de uma unidade da mantissa
+    float scale = std::bit_cast<float>(uint32_t(151 - shared_exponent) << 23);
+
+    // O arredondamento pode exigir um bit a mais
+    if (uint32_t(max_component * scale + 0.5f) == 512) {
+        shared_exponent++;
+        scale *= 0.5f;
+    }
+
+    return uint32_t(r * scale + 0.5f) |
+           uint32_t(g * scale + 0.5f) << 9 |
+           uint32_t(b * scale + 0.5f) << 18 |
+           uint32_t(shared_exponent) << 27;
+}
+
+static glm::vec4 rgb9e5_to_color(uint32_t texel)
+{
+    float scale = std::ldexp(1.0f, int(texel >> 27) - 24);
+    return glm::vec4((texel & 0x1FF) * scale,
+                     ((texel >> 9) & 0x1FF) * scale,
+                     ((texel >> 18) & 0x1FF) * scale,
+                     1.0f);
 }
 
 void GpuProgram::load_cubemap_from_hdr_files(std::vector<std::string_view> filename,
                                              std::string_view uniform)
 {
-    printf("Carregando texturas de cubemap...");
+    num_loaded_textures++;
 
-    // Primeiro fazemos a leitura da imagem do disco
-    stbi_set_flip_vertically_on_load(false);
+    for (int i = 0; i < 6; i++) {
+        std::string_view filepath = filename[i];
 
-    // Agora criamos objetos na GPU com OpenGL para armazenar a textura
-    GLuint texture_id;
-    GLuint textureunit = num_uploaded_textures;
-    glGenTextures(1, &texture_id);
-    glActiveTexture(GL_TEXTURE0 + textureunit);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id);
+        tex_futures.emplace_back(std::async(std::launch::async, [filepath, uniform, i]() {
 
-    for (int i = 0; i < 6; i++)
-    {
-        int width, height, channels;
-        float *data = stbi_loadf(filename[i].data(), &width, &height, &channels, 3);
+            // As faces de um cubemap não são invertidas
+            stbi_set_flip_vertically_on_load_thread(false);
 
-        if ( data == NULL )
-        {
-            fprintf(stderr, "ERROR: Cannot open image file \"%s\".\n", filename[i].data());
-            std::exit(EXIT_FAILURE);
-        }
+            int width, height, channels;
+            float *data = stbi_loadf(filepath.data(), &width, &height, &channels, 3);
 
-        printf("OK (%dx%d), ", width, height);
+            if (!data)
+                throw std::runtime_error( "ERROR: Cannot open image file \"" + std::string(filepath) + "\".");
 
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
+            std::cout << "Carregando imagem \"" << filepath << "\" ... OK (" << width << "x" << height << ")." << std::endl;
 
-        stbi_image_free(data);
+            // Com o expoente compartilhado, cada texel ocupa 4 bytes em vez
+            // dos 12 bytes de três floats, tanto no envio quanto na GPU
+            TextureData result;
+            result.uniform_name = uniform;
+            result.cubemap_face = true;
+            result.layer = i;
+            result.internal_format = GL_RGB9_E5;
+            result.format = GL_RGB;
+            result.type = GL_UNSIGNED_INT_5_9_9_9_REV;
+            result.texel_size = 4;
+            result.levels = {{width, height, 0}};
+            result.pixels.resize(size_t(width) * height * 4);
+
+            uint32_t* texels = reinterpret_cast<uint32_t*>(result.pixels.data());
+            for (size_t t = 0; t < size_t(width) * height; t++)
+                texels[t] = color_to_rgb9e5(data + 3 * t);
+
+            stbi_image_free(data);
+            return result;
+        }));
     }
+}
 
-    printf(".\n");
+// Conversões entre sRGB e valores lineares, para que a média dos texels de
+// cada nível seja feita no espaço linear, como em glGenerateMipmap()
+static float srgb_to_linear(unsigned char value)
+{
+    float c = value / 255.0f;
+    return (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+static unsigned char linear_to_srgb(float value)
+{
+    float c = (value <= 0.0031308f) ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    return (unsigned char)std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f);
+}
 
-    glUseProgram(id);
-    glUniform1i(glGetUniformLocation(id, uniform.data()), num_uploaded_textures);
-    glUseProgram(0);
+// Gera todos os níveis de mipmap da imagem na CPU, reduzindo cada nível pela
+// média de blocos de 2x2 texels. Com os níveis prontos, o envio para a GPU
+// pode ser dividido entre vários quadros.
+static void build_mipmaps(TextureData& tex, const unsigned char* data, int width, int height, int channels)
+{
+    static const std::array<float, 256> linear_table = [] {
+        std::array<float, 256> table;
+        for (int i = 0; i < 256; i++)
+            table[i] = srgb_to_linear(i);
+        return table;
+    }();
+
+    int c = channels;
+    bool srgb = c > 1;
+
+    size_t total_size = 0;
+    for (int w = width, h = height; ; w = std::max(w / 2, 1), h = std::max(h / 2, 1)) {
+        tex.levels.push_back({w, h, total_size});
+        total_size += size_t(w) * h * c;
+        if (w == 1 && h == 1)
+            break;
+    }
 
-    texture_uniforms.push_back(uniform);
+    tex.pixels.resize(total_size);
+    std::memcpy(tex.pixels.data(), data, size_t(width) * height * c);
+
+    for (size_t level = 1; level < tex.levels.size(); level++) {
+        const TextureLevel& src = tex.levels[level - 1];
+        const TextureLevel& dst = tex.levels[level];
+        const unsigned char* in = tex.pixels.data() + src.offset;
+        unsigned char* out = tex.pixels.data() + dst.offset;
+
+        for (int y = 0; y < dst.height; y++) {
+            int y0 = std::min(2 * y, src.height - 1);
+            int y1 = std::min(2 * y + 1, src.height - 1);
+
+            for (int x = 0; x < dst.width; x++) {
+                int x0 = std::min(2 * x, src.width - 1);
+                int x1 = std::min(2 * x + 1, src.width - 1);
+
+                for (int k = 0; k < c; k++) {
+                    unsigned char t[4] = {in[(y0 * src.width + x0) * c + k], in[(y0 * src.width + x1) * c + k],
+                                          in[(y1 * src.width + x0) * c + k], in[(y1 * src.width + x1) * c + k]};
+
+                    // O canal alfa não é codificado em sRGB
+                    if (srgb && k < 3) {
+                        float sum = linear_table[t[0]] + linear_table[t[1]] + linear_table[t[2]] + linear_table[t[3]];
+                        out[(y * dst.width + x) * c + k] = linear_to_srgb(sum * 0.25f);
+                    }
+                    else {
+                        out[(y * dst.width + x) * c + k] = (t[0] + t[1] + t[2] + t[3] + 2) / 4;
+                    }
+                }
+            }
+        }
+    }
+}
 
-    num_loaded_textures++;
-    num_uploaded_textures++;
+// Memória estimada de uma textura na GPU, com texels RGB ocupando 4 bytes
+static GLsizeiptr texture_memory_size(const TextureData& tex)
+{
+    GLsizeiptr texel_size = (tex.internal_format == GL_R8) ? 1 : 4;
+
+    GLsizeiptr size = 0;
+    for (const TextureLevel& level : tex.levels)
+        size += GLsizeiptr(level.width) * level.height * texel_size;
+
+    return size;
 }
 
 void GpuProgram::load_textures_async(std::vector<std::pair<std::string_view, std::string_view>> textures)
 {
-    stbi_set_flip_vertically_on_load(true);
+    num_loaded_textures += textures.size();
+    decode_textures_async(std::move(textures), false);
+}
+
+void GpuProgram::stream_textures_async(std::vector<std::pair<std::string_view, std::string_view>> textures)
+{
+    decode_textures_async(std::move(textures), true);
+}
 
+void GpuProgram::decode_textures_async(std::vector<std::pair<std::string_view, std::string_view>> textures,
+                                       bool upgrade)
+{
     for (const auto& [filepath, uniform] : textures) {
 
-        num_loaded_textures++;
+        tex_futures.emplace_back(std::async(std::launch::async, [filepath, uniform, upgrade]() {
+
+            // The setting of stb_image is per thread, cubemaps are decoded at
+            // the same time without flipping
+            stbi_set_flip_vertically_on_load_thread(true);
 
-        tex_futures.emplace_back(std::async(std::launch::async, [filepath, uniform]() {
+            TextureData result;
+            result.uniform_name = uniform;
+            result.upgrade = upgrade;
 
             int w, h, c;
             unsigned char* data = stbi_load(filepath.data(), &w, &h, &c, 0);
 
+            // Sem a versão de alta resolução, a textura atual é mantida
+            if (!data && upgrade) {
+                std::cout << "Imagem \"" << filepath << "\" não encontrada, mantendo a textura atual." << std::endl;
+                return result;
+            }
+
             if (!data)
                 throw std::runtime_error( "ERROR: Cannot open image file \"" + std::string(filepath) + "\".");
 
             std::cout << "Carregando imagem \"" << filepath << "\" ... OK (" << w << "x" << h << ")." << std::endl;
 
-            TextureData result;
-            result.uniform_name = uniform;
-            result.width = w;
-            result.height = h;
-            result.channels = c;
-            result.data = data;
+            result.internal_format = (c > 1) ? GL_SRGB8 : GL_R8;
+            result.format = (c > 1) ? GL_RGB : GL_RED;
+            result.texel_size = c;
+            build_mipmaps(result, data, w, h, c);
+
+            stbi_image_free(data);
             return result;
         }));
     }
@@ -325,64 +978,396 @@ bool GpuProgram::upload_pending_textures()
 {
     for (auto it = tex_futures.begin(); it != tex_futures.end(); ) {
         if (it->wait_for(std::chrono::milliseconds(0)) == std::future_status::ready) {
-            tex_queue.push(it->get());
+            decoded_textures.push_back(it->get());
             it = tex_futures.erase(it);
         } else {
             ++it;
         }
     }
 
-    // Upload ready textures to GPU
+    if (tex_futures.empty() && !decoded_textures.empty())
+        allocate_texture_arrays();
+
+    // The loader thread copies the textures straight from the application
+    // memory and without a time budget, as the copies no longer delay the
+    // frames drawn meanwhile. It reports each level it uploads.
+    if (GpuLoader::is_running()) {
+        submit_texture_uploads();
+        return tex_futures.empty() && texture_uploads.empty();
+    }
+
+    // Uploads continue until the budget runs out, at least one chunk per
+    // frame so that loading always advances
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<float, std::milli> budget(texture_upload_budget);
+
     while (!tex_queue.empty()) {
-        const auto& tex = tex_queue.front();
+        const TextureData& tex = tex_queue.front();
 
-        // Agora criamos objetos na GPU com OpenGL para armazenar a textura
-        GLuint texture_id;
-        GLuint sampler_id;
-        glGenTextures(1, &texture_id);
-        glGenSamplers(1, &sampler_id);
+        upload_texture_rows(tex, TEXTURE_UPLOAD_CHUNK_SIZE);
+
+        if (uploading_level == tex.levels.size()) {
+            finish_texture_upload(tex);
+            tex_queue.pop();
+        }
+
+        if (std::chrono::steady_clock::now() - start >= budget)
+            break;
+    }
+
+    return tex_futures.empty() && tex_queue.empty();
+}
+
+void GpuProgram::allocate_texture_arrays()
+{
+    if (array_sampler_id == 0) {
+        glGenSamplers(1, &array_sampler_id);
 
         // Veja slides 95-96 do documento Aula_20_Mapeamento_de_Texturas.pdf
-        glSamplerParameteri(sampler_id, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glSamplerParameteri(sampler_id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glSamplerParameteri(array_sampler_id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glSamplerParameteri(array_sampler_id, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
         // Parâmetros de amostragem da textura.
-        glSamplerParameteri(sampler_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glSamplerParameteri(sampler_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        glSamplerParameterf(sampler_id, GL_TEXTURE_MAX_ANISOTROPY_EXT, 8.0f);
-
-        // Agora enviamos a imagem lida do disco para a GPU
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
-        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
-
-        GLuint textureunit = num_uploaded_textures;
-        glActiveTexture(GL_TEXTURE0 + textureunit);
-        glBindTexture(GL_TEXTURE_2D, texture_id);
-        glTexImage2D(GL_TEXTURE_2D, 0,
-                     (tex.channels > 1) ? GL_SRGB8 : GL_R8,
-                     tex.width, tex.height, 0,
-                     (tex.channels > 1) ? GL_RGB : GL_RED,
-                     GL_UNSIGNED_BYTE, tex.data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glBindSampler(textureunit, sampler_id);
-
-        stbi_image_free(tex.data);
-
-        glUseProgram(id);
-        glUniform1i(glGetUniformLocation(id,
-                                         tex.uniform_name.data()),
-                                         num_uploaded_textures);
-        glUseProgram(0);
-
-        texture_uniforms.push_back(tex.uniform_name);
+        glSamplerParameteri(array_sampler_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glSamplerParameteri(array_sampler_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glSamplerParameterf(array_sampler_id, GL_TEXTURE_MAX_ANISOTROPY_EXT, 8.0f);
+    }
 
+    // Texturas com o mesmo formato e tamanho são agrupadas em um só array
+    std::map<std::tuple<GLenum, int, int>, std::vector<TextureData*>> groups;
+    std::map<std::string_view, std::vector<TextureData*>> cubemaps;
+    for (TextureData& tex : decoded_textures) {
+        // Upgrades without an image, or of textures never loaded, are skipped
+        if (tex.levels.empty() || (tex.upgrade && !texture_array_indices.contains(tex.uniform_name)))
+            continue;
+
+        if (tex.cubemap_face)
+            cubemaps[tex.uniform_name].push_back(&tex);
+        else
+            groups[{tex.internal_format, tex.levels[0].width, tex.levels[0].height}].push_back(&tex);
+    }
+
+    for (auto& [uniform, faces] : cubemaps)
+        allocate_cubemap(faces);
+
+    for (auto& [key, textures] : groups) {
+        const TextureData& first = *textures.front();
+        GLsizeiptr layer_memory = texture_memory_size(first);
+
+        // Both versions of an upgraded texture stay on the GPU until the new
+        // one is complete, so the old ones count against the cap
+        size_t num_layers = textures.size();
+        if (first.upgrade) {
+            num_layers = std::clamp(GLsizeiptr((texture_memory_cap - texture_memory) / layer_memory),
+                                    GLsizeiptr(0), GLsizeiptr(textures.size()));
+
+            for (size_t i = num_layers; i < textures.size(); i++)
+                std::cout << "Textura \"" << textures[i]->uniform_name << "\" mantida em baixa resolução, "
+                          << "limite de memória de " << (texture_memory_cap >> 20) << " MB." << std::endl;
+
+            if (num_layers == 0)
+                continue;
+        }
+
+        TextureArray array;
+        array.target = GL_TEXTURE_2D_ARRAY;
+        array.unit = num_texture_units++;
+        array.memory = layer_memory * num_layers;
+        texture_memory += array.memory;
+
+        // Agora criamos objetos na GPU com OpenGL para armazenar as texturas.
+        // Todos os níveis são alocados agora e preenchidos aos poucos, a
+        // partir do pixel buffer, nos quadros seguintes.
+        const std::vector<TextureLevel>& levels = first.levels;
+        if (GlExtensions::direct_state_access) {
+            glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &array.texture_id);
+            glTextureStorage3D(array.texture_id, levels.size(), first.internal_format,
+                               levels[0].width, levels[0].height, num_layers);
+            GlState::bind_texture(array.unit, GL_TEXTURE_2D_ARRAY, array.texture_id);
+        }
+        else {
+            glGenTextures(1, &array.texture_id);
+            GlState::bind_texture(array.unit, GL_TEXTURE_2D_ARRAY, array.texture_id);
+
+            for (size_t level = 0; level < levels.size(); level++)
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, first.internal_format,
+                             levels[level].width, levels[level].height, num_layers, 0,
+                             first.format, first.type, NULL);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+        }
+        GlState::bind_sampler(array.unit, array_sampler_id);
+
+        for (size_t layer = 0; layer < num_layers; layer++) {
+            textures[layer]->array = texture_arrays.size();
+            textures[layer]->layer = layer;
+            tex_queue.push(std::move(*textures[layer]));
+        }
+
+        texture_arrays.push_back(array);
+    }
+
+    // Upgrades left out are no longer needed
+    decoded_textures.clear();
+}
+
+void GpuProgram::allocate_cubemap(std::vector<TextureData*>& faces)
+{
+    const TextureLevel& size = faces.front()->levels[0];
+
+    TextureArray cubemap;
+    cubemap.target = GL_TEXTURE_CUBE_MAP;
+    cubemap.unit = num_texture_units++;
+    cubemap.memory = 6 * texture_memory_size(*faces.front());
+    texture_memory += cubemap.memory;
+
+    if (GlExtensions::direct_state_access) {
+        glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &cubemap.texture_id);
+        glTextureStorage2D(cubemap.texture_id, 1, faces.front()->internal_format, size.width, size.height);
+
+        glTextureParameteri(cubemap.texture_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(cubemap.texture_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(cubemap.texture_id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(cubemap.texture_id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(cubemap.texture_id, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+        GlState::bind_texture(cubemap.unit, GL_TEXTURE_CUBE_MAP, cubemap.texture_id);
+    }
+    else {
+        glGenTextures(1, &cubemap.texture_id);
+        GlState::bind_texture(cubemap.unit, GL_TEXTURE_CUBE_MAP, cubemap.texture_id);
+
+        for (int i = 0; i < 6; i++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, faces.front()->internal_format,
+                         size.width, size.height, 0, faces.front()->format, faces.front()->type, NULL);
+
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+    }
+
+    for (TextureData* face : faces) {
+        face->array = texture_arrays.size();
+        tex_queue.push(std::move(*face));
+    }
+
+    texture_arrays.push_back(cubemap);
+}
+
+void GpuProgram::upload_texture_rows(const TextureData& tex, GLsizeiptr max_size)
+{
+    const TextureLevel& level = tex.levels[uploading_level];
+    GLsizeiptr row_size = GLsizeiptr(level.width) * tex.texel_size;
+    int rows = std::clamp(int(max_size / row_size), 1, level.height - uploading_row);
+    GLsizeiptr size = rows * row_size;
+
+    if (upload_pbo_id == 0)
+        glGenBuffers(1, &upload_pbo_id);
+
+    // The previous storage is orphaned, so the copy never waits for the
+    // transfer of the last chunk to finish
+    GlState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, upload_pbo_id);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped) {
+        std::memcpy(mapped, tex.pixels.data() + level.offset + uploading_row * row_size, size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+
+    // Cube map faces are layers of the texture when edited by name
+    const TextureArray& array = texture_arrays[tex.array];
+    if (GlExtensions::direct_state_access) {
+        glTextureSubImage3D(array.texture_id, uploading_level, 0, uploading_row, tex.layer,
+                            level.width, rows, 1, tex.format, tex.type, NULL);
+    }
+    else {
+        // The upload applies to the texture bound to the active unit
+        GlState::bind_texture(array.unit, array.target, array.texture_id);
+
+        if (tex.cubemap_face)
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + tex.layer, uploading_level,
+                            0, uploading_row, level.width, rows, tex.format, tex.type, NULL);
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, uploading_level, 0, uploading_row, tex.layer,
+                            level.width, rows, 1, tex.format, tex.type, NULL);
+    }
+
+    // Other uploads read from client memory
+    GlState::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    uploading_row += rows;
+    if (uploading_row == level.height) {
+        uploading_level++;
+        uploading_row = 0;
+    }
+}
+
+// Envia todos os níveis de uma textura diretamente da memória da aplicação,
+// na thread de carregamento. A textura é desligada ao final, para que possa
+// ser apagada pela thread principal. Cada nível enviado é contado, para que a
+// thread principal acompanhe o progresso.
+static void upload_texture_levels(const TextureArray& array, const TextureData& tex,
+                                  std::atomic<size_t>& uploaded_levels)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    bool bind = !GlExtensions::direct_state_access;
+    if (bind) {
+        GlState::bind_texture(0, array.target, array.texture_id);
+    }
+
+    for (size_t i = 0; i < tex.levels.size(); i++) {
+        const TextureLevel& level = tex.levels[i];
+        const unsigned char* pixels = tex.pixels.data() + level.offset;
+
+        if (!bind)
+            glTextureSubImage3D(array.texture_id, i, 0, 0, tex.layer,
+                                level.width, level.height, 1, tex.format, tex.type, pixels);
+        else if (tex.cubemap_face)
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + tex.layer, i,
+                            0, 0, level.width, level.height, tex.format, tex.type, pixels);
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, tex.layer,
+                            level.width, level.height, 1, tex.format, tex.type, pixels);
+
+        uploaded_levels++;
+    }
+
+    if (bind)
+        GlState::bind_texture(0, array.target, 0);
+}
+
+void GpuProgram::submit_texture_uploads()
+{
+    while (!tex_queue.empty()) {
+        // The layers of an array are queued one after the other and sent by
+        // a single job, so the render thread never samples an array the
+        // loader is still writing to
+        auto batch = std::make_shared<TextureUpload>();
+        size_t array_index = tex_queue.front().array;
+        while (!tex_queue.empty() && tex_queue.front().array == array_index) {
+            batch->textures.push_back(std::move(tex_queue.front()));
+            tex_queue.pop();
+        }
+
+        TextureArray array = texture_arrays[array_index];
+        texture_uploads.push_back(batch);
+
+        GpuLoader::submit([array, batch]() {
+                for (const TextureData& tex : batch->textures)
+                    upload_texture_levels(array, tex, batch->uploaded_levels);
+            },
+            [this, array, batch]() {
+                // Contents changed by another context are only guaranteed to
+                // be seen after the texture is bound again
+                GlState::bind_texture(array.unit, array.target, 0);
+                GlState::bind_texture(array.unit, array.target, array.texture_id);
+
+                for (const TextureData& tex : batch->textures)
+                    finish_texture_upload(tex);
+                std::erase(texture_uploads, batch);
+            });
+    }
+}
+
+void GpuProgram::finish_texture_upload(const TextureData& tex)
+{
+    if (tex.cubemap_face) {
+        // A cor da neblina é a cor do céu logo abaixo do horizonte, antes
+        // amostrada no fragment shader na direção (0.5, -0.01, 0.5). Essa
+        // direção cai na face +X, na coordenada de textura (0.0, 0.51).
+        if (tex.layer == 0) {
+            int row = std::min(tex.levels[0].height - 1, int(0.51f * tex.levels[0].height));
+            uint32_t texel;
+            std::memcpy(&texel, tex.pixels.data() + size_t(row) * tex.levels[0].width * 4, 4);
+            fog_color = rgb9e5_to_color(texel);
+        }
+
+        // The cubemap is only sampled once all faces are complete
+        TextureArray& cubemap = texture_arrays[tex.array];
+        if (++cubemap.num_users == 6) {
+            set_texture_uniform(tex.uniform_name, cubemap.unit);
+            num_uploaded_textures++;
+        }
+
+        uploading_level = 0;
+        return;
+    }
+
+    texture_arrays[tex.array].num_users++;
+
+    auto it = texture_array_indices.find(tex.uniform_name);
+    if (it != texture_array_indices.end()) {
+        // The array with the previous version is deleted once unused
+        TextureArray& previous = texture_arrays[it->second];
+        if (--previous.num_users == 0) {
+            GlState::bind_texture(previous.unit, previous.target, 0);
+            glDeleteTextures(1, &previous.texture_id);
+            texture_memory -= previous.memory;
+        }
+
+        it->second = tex.array;
+    }
+    else {
+        texture_array_indices.emplace(tex.uniform_name, tex.array);
+    }
+
+    // Both uniforms change between two draws, so no frame sees a texture
+    // that is not complete
+    set_texture_uniform(tex.uniform_name, texture_arrays[tex.array].unit);
+    set_texture_uniform(std::string(tex.uniform_name) + "Layer", tex.layer);
+
+    if (!tex.upgrade)
         num_uploaded_textures++;
 
-        tex_queue.pop();
+    uploading_level = 0;
+}
+
+// Part of a texture that counts towards the loading progress once the given
+// number of its levels is uploaded. The six faces of a cubemap count as a
+// single texture, and upgrades are not part of the loading.
+static float texture_upload_fraction(const TextureData& tex, size_t levels)
+{
+    if (tex.upgrade)
+        return 0.0f;
+
+    float fraction = float(levels) / float(tex.levels.size());
+    return tex.cubemap_face ? fraction / 6.0f : fraction;
+}
+
+float GpuProgram::get_upload_progress() const
+{
+    if (num_loaded_textures == 0)
+        return 1.0f;
+
+    float progress = num_uploaded_textures;
+    if (!tex_queue.empty())
+        progress += texture_upload_fraction(tex_queue.front(), uploading_level);
+
+    // Faces of cubemaps that are not complete yet
+    for (const TextureArray& array : texture_arrays)
+        if (array.target == GL_TEXTURE_CUBE_MAP && array.num_users < 6)
+            progress += array.num_users / 6.0f;
+
+    // The loader thread uploads the textures of a job in order
+    for (const auto& batch : texture_uploads) {
+        size_t levels = batch->uploaded_levels;
+        for (const TextureData& tex : batch->textures) {
+            size_t done = std::min(levels, tex.levels.size());
+            progress += texture_upload_fraction(tex, done);
+            levels -= done;
+        }
     }
 
-    return tex_futures.empty() && tex_queue.empty();
+    return progress / num_loaded_textures;
 }
@@ -0,0 +1,180 @@
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include "gpu_loader.hpp"
+
+GLFWwindow* GpuLoader::shared_window = NULL;
+std::thread GpuLoader::thread;
+
+std::mutex GpuLoader::mutex;
+std::condition_variable GpuLoader::job_submitted;
+std::condition_variable GpuLoader::job_finished;
+
+std::deque<GpuLoader::Job> GpuLoader::jobs;
+std::deque<GpuLoader::Job> GpuLoader::finished_jobs;
+bool GpuLoader::busy = false;
+bool GpuLoader::stopping = false;
+
+void GpuLoader::start(GLFWwindow* window)
+{
+    // The context hints of the window are still set, so the loader gets a
+    // context of the same version
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    shared_window = glfwCreateWindow(1, 1, "", NULL, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+    if (!shared_window) {
+        std::cerr << "Contexto compartilhado indisponível, recursos enviados pela thread principal." << std::endl;
+        return;
+    }
+
+    stopping = false;
+    thread = std::thread(run);
+
+    // Error paths end the program with exit(), and the thread must be joined
+    // before the static members it waits on are destroyed
+    std::atexit(stop);
+}
+
+void GpuLoader::stop()
+{
+    if (!is_running())
+        return;
+
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    job_submitted.notify_one();
+    thread.join();
+
+    // Sync objects are shared, so the render thread can delete them
+    for (Job& job : jobs)
+        glDeleteSync(job.fence);
+    for (Job& job : finished_jobs)
+        glDeleteSync(job.fence);
+    jobs.clear();
+    finished_jobs.clear();
+
+    glfwDestroyWindow(shared_window);
+    shared_window = NULL;
+}
+
+bool GpuLoader::is_running()
+{
+    return shared_window != NULL;
+}
+
+bool GpuLoader::has_pending_work()
+{
+    if (!is_running())
+        return false;
+
+    std::lock_guard lock(mutex);
+    return !jobs.empty() || busy || !finished_jobs.empty();
+}
+
+void GpuLoader::submit(std::function<void()> work, std::function<void()> completion)
+{
+    // The flush makes sure the fence reaches the GPU, otherwise the loader
+    // could wait for it forever
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    {
+        std::lock_guard lock(mutex);
+        jobs.push_back({std::move(work), std::move(completion), fence});
+    }
+    job_submitted.notify_one();
+}
+
+void GpuLoader::wait_idle()
+{
+    if (!is_running())
+        return;
+
+    std::vector<GLsync> fences;
+    {
+        std::unique_lock lock(mutex);
+        job_finished.wait(lock, [] { return jobs.empty() && !busy; });
+
+        for (Job& job : finished_jobs)
+            fences.push_back(job.fence);
+    }
+
+    // The wait happens on the GPU, the fences are still checked by end_frame()
+    for (GLsync fence : fences)
+        glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+}
+
+void GpuLoader::end_frame()
+{
+    if (!is_running())
+        return;
+
+    // Only this thread removes finished jobs, so the front stays the same
+    // while its fence is checked without holding the lock. Jobs finish in
+    // order, so the first unsignaled fence stops the check.
+    std::vector<std::function<void()>> completions;
+    while (true) {
+        GLsync fence;
+        {
+            std::lock_guard lock(mutex);
+            if (finished_jobs.empty())
+                break;
+            fence = finished_jobs.front().fence;
+        }
+
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            break;
+        glDeleteSync(fence);
+
+        std::lock_guard lock(mutex);
+        if (finished_jobs.front().completion)
+            completions.push_back(std::move(finished_jobs.front().completion));
+        finished_jobs.pop_front();
+    }
+
+    // Completions may submit more work
+    for (auto& completion : completions)
+        completion();
+}
+
+void GpuLoader::run()
+{
+    glfwMakeContextCurrent(shared_window);
+
+    std::unique_lock lock(mutex);
+    while (true) {
+        job_submitted.wait(lock, [] { return stopping || !jobs.empty(); });
+        if (stopping)
+            break;
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        busy = true;
+        lock.unlock();
+
+        glWaitSync(job.fence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(job.fence);
+
+        if (job.work)
+            job.work();
+
+        job.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        lock.lock();
+        busy = false;
+        finished_jobs.push_back(std::move(job));
+        job_finished.notify_all();
+    }
+    lock.unlock();
+
+    glfwMakeContextCurrent(NULL);
+}
@@ -0,0 +1,159 @@
+#include <glad/gl.h>
+
+#include "gpu_timer.hpp"
+
+// Weight of each new frame in the smoothed times
+#define GPU_TIMER_SMOOTHING 0.05f
+
+std::array<GpuTimer::Frame, GPU_TIMER_FRAMES> GpuTimer::frames;
+size_t GpuTimer::frame = 0;
+bool GpuTimer::created = false;
+
+bool GpuTimer::timing = true;
+bool GpuTimer::scope_open = false;
+
+std::vector<GpuTimer::ScopeTime> GpuTimer::times;
+unsigned long GpuTimer::frames_read = 0;
+FILE* GpuTimer::csv_file = NULL;
+
+void GpuTimer::create()
+{
+    for (Frame& f : frames)
+        glGenQueries(GLsizei(f.queries.size()), f.queries.data());
+
+    created = true;
+}
+
+size_t GpuTimer::find_scope(std::string_view name)
+{
+    for (size_t i = 0; i < times.size(); i++)
+        if (times[i].name == name)
+            return i;
+
+    times.push_back({std::string(name), 0.0f});
+    return times.size() - 1;
+}
+
+void GpuTimer::begin(std::string_view name)
+{
+    end();
+
+    if (!created)
+        create();
+
+    Frame& f = frames[frame];
+    if (!timing || f.num_scopes == GPU_TIMER_MAX_SCOPES)
+        return;
+
+    f.scopes[f.num_scopes] = find_scope(name);
+    glQueryCounter(f.queries[2 * f.num_scopes], GL_TIMESTAMP);
+    scope_open = true;
+}
+
+void GpuTimer::end()
+{
+    if (!scope_open)
+        return;
+
+    Frame& f = frames[frame];
+    glQueryCounter(f.queries[2 * f.num_scopes + 1], GL_TIMESTAMP);
+    f.num_scopes++;
+    scope_open = false;
+}
+
+void GpuTimer::end_frame()
+{
+    end();
+
+    if (!created)
+        return;
+
+    if (timing && frames[frame].num_scopes > 0)
+        frames[frame].pending = true;
+
+    frame = (frame + 1) % GPU_TIMER_FRAMES;
+    read_results();
+
+    // Frames are not timed while all of them are waiting for results
+    timing = !frames[frame].pending;
+    if (timing)
+        frames[frame].num_scopes = 0;
+}
+
+void GpuTimer::read_results()
+{
+    // Frames finish in the order they were issued, starting from the oldest,
+    // which is the one about to be reused
+    for (size_t i = 0; i < GPU_TIMER_FRAMES; i++) {
+        Frame& f = frames[(frame + i) % GPU_TIMER_FRAMES];
+        if (!f.pending)
+            continue;
+
+        // The last query of the frame is the last to finish
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(f.queries[2 * f.num_scopes - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        std::vector<double> frame_times(times.size(), 0.0);
+        for (int scope = 0; scope < f.num_scopes; scope++) {
+            GLuint64 start = 0, stop = 0;
+            glGetQueryObjectui64v(f.queries[2 * scope], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(f.queries[2 * scope + 1], GL_QUERY_RESULT, &stop);
+
+            if (stop > start)
+                frame_times[f.scopes[scope]] += (stop - start) / 1e6;
+        }
+        f.pending = false;
+
+        // Scopes missing from the frame count as zero, such as the depth
+        // pre-pass when another render mode is chosen
+        for (size_t scope = 0; scope < times.size(); scope++) {
+            float& smoothed = times[scope].milliseconds;
+            smoothed += GPU_TIMER_SMOOTHING * (float(frame_times[scope]) - smoothed);
+        }
+
+        if (csv_file) {
+            for (int scope = 0; scope < f.num_scopes; scope++) {
+                // Repeated scopes are written once, with their sum
+                size_t index = f.scopes[scope];
+                bool first = true;
+                for (int previous = 0; previous < scope; previous++)
+                    if (f.scopes[previous] == index)
+                        first = false;
+
+                if (first)
+                    fprintf(csv_file, "%lu,%s,%.4f\n", frames_read, times[index].name.c_str(), frame_times[index]);
+            }
+
+            // Rows already read back are kept if the program ends abnormally
+            fflush(csv_file);
+        }
+
+        frames_read++;
+    }
+}
+
+const std::vector<GpuTimer::ScopeTime>& GpuTimer::get_times()
+{
+    return times;
+}
+
+bool GpuTimer::open_csv(const char* path)
+{
+    csv_file = fopen(path, "w");
+    if (!csv_file)
+        return false;
+
+    fprintf(csv_file, "frame,scope,milliseconds\n");
+    return true;
+}
+
+void GpuTimer::close_csv()
+{
+    if (!csv_file)
+        return;
+
+    fclose(csv_file);
+    csv_file = NULL;
+}
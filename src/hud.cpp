@@ -8,10 +8,72 @@
 #include <glm/vec2.hpp>
 
 #include "input.hpp"
+#include "gpu.hpp"
+#include "gl_state.hpp"
+#include "gpu_timer.hpp"
+#include "stream_buffer.hpp"
+#include "object.hpp"
 #include "textrendering.hpp"
 #include "hud.hpp"
 
 #define TIMINGS_UPDATE_INTERVAL 1.0f
+#define VALUES_UPDATE_INTERVAL 0.1f
+
+Label::Label(glm::vec2 p, std::string t, float s)
+{
+    pos = p;
+    text = t;
+    scale = s;
+}
+
+Label::~Label()
+{
+    TextRendering_DeleteGeometry(geometry);
+}
+
+void Label::set_text(std::string t)
+{
+    if (text == t)
+        return;
+
+    text = t;
+    dirty = true;
+}
+
+void Label::set_position(glm::vec2 p)
+{
+    if (pos == p)
+        return;
+
+    pos = p;
+    dirty = true;
+}
+
+void Label::set_scale(float s)
+{
+    if (scale == s)
+        return;
+
+    scale = s;
+    dirty = true;
+}
+
+const std::string& Label::get_text() const
+{
+    return text;
+}
+
+void Label::draw()
+{
+    if (dirty || window_size_version != TextRendering_WindowSizeVersion()) {
+        TextRendering_BuildGeometry(geometry, text, pos.x, pos.y, scale);
+
+        window_size_version = TextRendering_WindowSizeVersion();
+        dirty = false;
+    }
+
+    TextRendering_DrawGeometry(geometry);
+}
 
 Button::Button(GLFWwindow *w, InputManager *i, glm::vec2 pos, std::string t, float s)
 {
@@ -19,14 +81,15 @@ Button::Button(GLFWwindow *w, InputManager *i, glm::vec2 pos, std::string t, flo
     input = i;
     pos_start.x = pos.x;
     pos_end.y = pos.y;
-    text = t;
 
+    label.set_text(t);
     set_scale(s);
 }
 
 void Button::set_text(std::string t)
 {
-    text = t;
+    label.set_text(t);
+    update_bounds();
 }
 
 void Button::set_scale(float s)
@@ -36,11 +99,21 @@ void Button::set_scale(float s)
 
     scale = s;
 
+    label.set_scale(scale);
+    update_bounds();
+}
+
+void Button::update_bounds()
+{
+    window_size_version = TextRendering_WindowSizeVersion();
+
     float lineheight = TextRendering_LineHeight(window) * scale;
     float charwidth = TextRendering_CharWidth(window) * scale;
 
     pos_start.y = pos_end.y - lineheight;
-    pos_end.x = pos_start.x + charwidth * text.length();
+    pos_end.x = pos_start.x + charwidth * label.get_text().length();
+
+    label.set_position(pos_start);
 }
 
 bool Button::is_selecting()
@@ -68,7 +141,10 @@ bool Button::is_clicked()
 
 void Button::draw()
 {
-    TextRendering_PrintString(window, text, pos_start.x, pos_start.y, scale);
+    if (window_size_version != TextRendering_WindowSizeVersion())
+        update_bounds();
+
+    label.draw();
 }
 
 Hud::Hud(GLFWwindow *w, std::shared_ptr<Camera> *c)
@@ -80,11 +156,25 @@ Hud::Hud(GLFWwindow *w, std::shared_ptr<Camera> *c)
     debug_renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
     debug_glversion = reinterpret_cast<const char*>(glGetString(GL_VERSION));
     debug_glslversion = reinterpret_cast<const char*>(glGetString(GL_SHADING_LANGUAGE_VERSION));
+
+    for (int i = 0; i < DEBUG_LINE_COUNT; i++)
+        debug_labels.push_back(std::make_unique<Label>());
+
+    // Text that never changes is laid out only once
+    debug_labels[DEBUG_GPU]->set_text(std::format("GPU: {}, {}", debug_vendor, debug_renderer));
+    debug_labels[DEBUG_OPENGL]->set_text(std::format("OpenGL {}, GLSL {}", debug_glversion, debug_glslversion));
+    debug_labels[DEBUG_FPS]->set_scale(1.25f);
 }
 
 void Hud::toggle_debug_info(bool b)
 {
     show_debug_info = b;
+
+    // Labels are not updated while hidden
+    if (show_debug_info) {
+        update_timing_labels();
+        update_value_labels();
+    }
 }
 
 void Hud::toggle_debug_info()
@@ -92,7 +182,12 @@ void Hud::toggle_debug_info()
     toggle_debug_info(!show_debug_info);
 }
 
-void Hud::update_timings()
+void Hud::set_scene_target(const SceneTarget* s)
+{
+    scene_target = s;
+}
+
+bool Hud::update_timings()
 {
     static float old_seconds = (float)glfwGetTime();
     static int ellapsed_frames = 0;
@@ -112,57 +207,119 @@ void Hud::update_timings()
 
         old_seconds = seconds;
         ellapsed_frames = 0;
+
+        return true;
     }
+
+    return false;
 }
 
-void Hud::update(glm::vec2 cur, glm::vec4 cur_i)
+bool Hud::update(glm::vec2 cur, glm::vec4 cur_i)
 {
-    update_timings();
-
     cursor_pos = cur;
     cursor_intersection = cur_i;
+
+    if (!show_debug_info)
+        return false;
+
+    float seconds = (float)glfwGetTime();
+    if (seconds - values_update_time > VALUES_UPDATE_INTERVAL) {
+        update_value_labels();
+        values_update_time = seconds;
+        return true;
+    }
+
+    return false;
+}
+
+void Hud::update_timing_labels()
+{
+    debug_labels[DEBUG_FPS]->set_text(std::format("{:.2f} FPS", fps));
+    debug_labels[DEBUG_FRAMETIME]->set_text(std::format("Frametime: {:.2f} ms", frametime));
+    debug_labels[DEBUG_GL_CALLS]->set_text(std::format("Uniform uploads skipped: {}, state changes: {} issued, {} filtered, streamed: {} KB, {} stalls",
+                                                       GpuProgram::gl_calls_avoided_last_frame,
+                                                       GlState::changes_issued_last_frame,
+                                                       GlState::changes_filtered_last_frame,
+                                                       StreamBuffer::bytes_written_last_frame / 1024,
+                                                       StreamBuffer::stalls));
+}
+
+void Hud::update_value_labels()
+{
+    glm::vec4 cam_pos = camera->get()->get_position();
+
+    debug_labels[DEBUG_CAMERA]->set_text(std::format("Camera position: X: {:.2f} Y: {:.2f} Z: {:.2f}",
+                                                     cam_pos.x, cam_pos.y, cam_pos.z));
+    debug_labels[DEBUG_CULLING]->set_text(std::format("Draw calls: {}, instances: {} drawn, {} culled{}",
+                                                      Object::render_stats_last_frame.draw_calls,
+                                                      Object::render_stats_last_frame.instances_drawn,
+                                                      Object::render_stats_last_frame.instances_culled,
+                                                      Object::frustum_culling ? "" : " (culling off)"));
+    debug_labels[DEBUG_TRIANGLES]->set_text(std::format("Triangles: {} drawn, {} without LOD",
+                                                        Object::render_stats_last_frame.triangles_drawn,
+                                                        Object::render_stats_last_frame.triangles_without_lod));
+    if (scene_target)
+        debug_labels[DEBUG_RESOLUTION]->set_text(std::format("Resolution scale: {:.2f} ({}x{} of {}x{}), {}, scene GPU time: {:.2f} ms, target {:.2f} ms",
+                                                             scene_target->get_scale(),
+                                                             scene_target->get_size().x, scene_target->get_size().y,
+                                                             scene_target->get_window_size().x, scene_target->get_window_size().y,
+                                                             scene_target->get_anti_aliasing_description(),
+                                                             scene_target->get_gpu_time(), SceneTarget::target_gpu_time));
+
+    std::string scope_times = "GPU time per pass:";
+    for (const auto& scope : GpuTimer::get_times())
+        scope_times += std::format(" {} {:.2f} ms", scope.name, scope.milliseconds);
+    debug_labels[DEBUG_GPU_SCOPES]->set_text(scope_times);
+
+    debug_labels[DEBUG_CURSOR]->set_text(std::format("Cursor position: X: {:.2f} Y: {:.2f}",
+                                                     cursor_pos.x, cursor_pos.y));
+    debug_labels[DEBUG_INTERSECTION]->set_text(std::format("Cursor-Board intersection position: X: {:.2f} Y: {:.2f} Z: {:.2f}",
+                                                           cursor_intersection.x, cursor_intersection.y, cursor_intersection.z));
+    debug_labels[DEBUG_PROJECTION]->set_text(camera->get()->is_projection_perspective() ? "Perspective" : "Orthographic");
 }
 
 void Hud::draw()
 {
-    glDisable(GL_DEPTH_TEST);
+    // Updates that skip drawing do not count as frames
+    bool new_timings = update_timings();
 
-    if (show_debug_info)
-        render_debug_info();
+    if (!show_debug_info)
+        return;
 
-    glEnable(GL_DEPTH_TEST);
+    if (new_timings)
+        update_timing_labels();
+
+    render_debug_info();
 }
 
-void Hud::render_debug_info()
+void Hud::layout_debug_info()
 {
     float lineheight = TextRendering_LineHeight(window);
 
-    TextRendering_PrintString(window, std::format("GPU: {}, {}\n",
-                                        debug_vendor, debug_renderer),
-                              HUD_START, HUD_TOP - lineheight);
-    TextRendering_PrintString(window, std::format("OpenGL {}, GLSL {}\n",
-                                        debug_glversion, debug_glslversion),
-                              HUD_START, HUD_TOP - 2*lineheight);
+    debug_labels[DEBUG_GPU]->set_position(glm::vec2(HUD_START, HUD_TOP - lineheight));
+    debug_labels[DEBUG_OPENGL]->set_position(glm::vec2(HUD_START, HUD_TOP - 2*lineheight));
 
-    TextRendering_PrintString(window, std::format("{:.2f} FPS", fps),
-                              HUD_START, HUD_TOP - 4*lineheight, 1.25f);
-    TextRendering_PrintString(window, std::format("Frametime: {:.2f} ms", frametime),
-                              HUD_START, HUD_TOP - 5*lineheight);
+    debug_labels[DEBUG_FPS]->set_position(glm::vec2(HUD_START, HUD_TOP - 4*lineheight));
+    debug_labels[DEBUG_FRAMETIME]->set_position(glm::vec2(HUD_START, HUD_TOP - 5*lineheight));
+    debug_labels[DEBUG_GL_CALLS]->set_position(glm::vec2(HUD_START, HUD_TOP - 6*lineheight));
+    debug_labels[DEBUG_RESOLUTION]->set_position(glm::vec2(HUD_START, HUD_TOP - 7*lineheight));
+    debug_labels[DEBUG_GPU_SCOPES]->set_position(glm::vec2(HUD_START, HUD_TOP - 8*lineheight));
 
-    glm::vec4 cam_pos = camera->get()->get_position();
+    debug_labels[DEBUG_CAMERA]->set_position(glm::vec2(HUD_START, HUD_TOP - 9*lineheight));
+    debug_labels[DEBUG_CULLING]->set_position(glm::vec2(HUD_START, HUD_TOP - 10*lineheight));
+    debug_labels[DEBUG_TRIANGLES]->set_position(glm::vec2(HUD_START, HUD_TOP - 11*lineheight));
 
-    TextRendering_PrintString(window, std::format("Camera position: X: {:.2f} Y: {:.2f} Z: {:.2f}",
-                                        cam_pos.x, cam_pos.y, cam_pos.z),
-                              HUD_START, HUD_TOP - 7*lineheight);
+    debug_labels[DEBUG_CURSOR]->set_position(glm::vec2(HUD_START, HUD_TOP - 12*lineheight));
+    debug_labels[DEBUG_INTERSECTION]->set_position(glm::vec2(HUD_START, HUD_TOP - 13*lineheight));
 
-    TextRendering_PrintString(window, std::format("Cursor position: X: {:.2f} Y: {:.2f}",
-                                        cursor_pos.x, cursor_pos.y),
-                              HUD_START, HUD_TOP - 9*lineheight);
+    debug_labels[DEBUG_PROJECTION]->set_position(glm::vec2(HUD_START, HUD_BOTTOM + 2*lineheight/10));
+}
 
-    TextRendering_PrintString(window, std::format("Cursor-Board intersection position: X: {:.2f} Y: {:.2f} Z: {:.2f}",
-                                        cursor_intersection.x, cursor_intersection.y, cursor_intersection.z),
-                              HUD_START, HUD_TOP - 10*lineheight);
+void Hud::render_debug_info()
+{
+    // Positions only change when the window is resized
+    layout_debug_info();
 
-    TextRendering_PrintString(window, camera->get()->is_projection_perspective() ? "Perspective" : "Orthographic",
-                              HUD_START, HUD_BOTTOM + 2*lineheight/10);
+    for (auto& label : debug_labels)
+        label->draw();
 }
@@ -98,6 +98,44 @@ bool InputManager::get_is_mouse_button_released(int button)
            mouse_buttons[button] != last_mouse_buttons[button];
 }
 
+bool InputManager::has_activity()
+{
+    if (!is_enabled)
+        return false;
+
+    // Held keys keep moving the camera, releases are changes of their own
+    if (keys != last_keys || mouse_buttons != last_mouse_buttons)
+        return true;
+
+    for (const auto& [key, is_down] : keys)
+        if (is_down)
+            return true;
+
+    for (const auto& [button, is_down] : mouse_buttons)
+        if (is_down)
+            return true;
+
+    if (cursor_position != last_cursor_position || scroll_offset != glm::vec2(0.0f, 0.0f))
+        return true;
+
+    // Gamepads send no events, their state is read on every call
+    for (int joystick = 0; joystick < MAX_GAMEPADS; joystick++) {
+        for (int button : managed_gamepad_buttons)
+            if (get_is_gamepad_button_down(joystick, button))
+                return true;
+
+        // Released triggers rest at -1
+        for (int axis : managed_gamepad_axes) {
+            float value = get_gamepad_axis_value(joystick, axis);
+            bool trigger = axis == GLFW_GAMEPAD_AXIS_LEFT_TRIGGER || axis == GLFW_GAMEPAD_AXIS_RIGHT_TRIGGER;
+            if (trigger ? value > -1.0f : value != 0.0f)
+                return true;
+        }
+    }
+
+    return false;
+}
+
 void InputManager::update()
 {
     gamepad_state_is_updated.fill(false);
@@ -9,13 +9,25 @@
 //
 
 #define _USE_MATH_DEFINES
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
 
 // Headers abaixo são específicos de C++
+#include <algorithm>
 #include <memory>
 
 #include "gpu.hpp"
+#include "gl_state.hpp"
+#include "gl_extensions.hpp"
+#include "gpu_loader.hpp"
+#include "gpu_timer.hpp"
+#include "program_cache.hpp"
+#include "object.hpp"
+#include "scene_target.hpp"
+#include "stream_buffer.hpp"
 
 // Headers das bibliotecas OpenGL
 #define GLAD_GL_IMPLEMENTATION
@@ -38,18 +50,96 @@
 #include "state.hpp"
 #include "states/base.hpp"
 
+// Tempo máximo de espera por eventos no modo sob demanda, em segundos. Os
+// estados continuam sendo atualizados nesse intervalo mesmo sem entrada.
+#define ON_DEMAND_WAIT_TIMEOUT 0.1
+
+// Intervalo entre os relatórios de quadros desenhados e uso de CPU, em segundos
+#define ACTIVITY_REPORT_INTERVAL 60.0
+
 void FramebufferSizeCallback(GLFWwindow* window, int width, int height);
 
-void print_system_info();
+void print_system_info(bool on_demand_rendering);
+
+bool parse_positive(const char* option, const char* text, float& value);
 
-int main()
+int main(int argc, char* argv[])
 {
+    // Com --cold-shader-cache, todos os programas de GPU são compilados
+    // novamente, permitindo comparar o tempo de inicialização com o cache.
+    // Os demais argumentos definem a faixa da escala de resolução da cena e o
+    // tempo de GPU por quadro que ela busca atingir, em milissegundos.
+    // Com --no-multi-draw, os objetos são desenhados um a um mesmo quando
+    // glMultiDrawElementsIndirect está disponível, e com
+    // --no-direct-state-access o caminho de OpenGL 3.3 é usado mesmo quando
+    // há um contexto 4.5, ligando os objetos para editá-los.
+    // --texture-upload-budget limita o tempo gasto por quadro enviando
+    // texturas, em milissegundos, e --texture-memory-cap a memória de
+    // texturas, em MB, acima da qual as versões de alta resolução não são
+    // carregadas. Com --no-loader-thread, buffers e texturas são enviados
+    // pela thread principal, entre os quadros, em vez de por uma thread com
+    // um contexto compartilhado. Com --on-demand-rendering, quadros só são
+    // desenhados quando algo na tela muda, e o programa dorme esperando por
+    // eventos no restante do tempo. --gpu-timings-csv grava o tempo de GPU de
+    // cada etapa do quadro no arquivo dado, para comparações posteriores.
+    bool cold_shader_cache = false;
+    bool multi_draw = true;
+    bool direct_state_access = true;
+    bool loader_thread = true;
+    bool on_demand_rendering = false;
+    float min_scale = SceneTarget::min_scale;
+    float max_scale = SceneTarget::max_scale;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--cold-shader-cache") == 0)
+            cold_shader_cache = true;
+        else if (std::strcmp(argv[i], "--no-multi-draw") == 0)
+            multi_draw = false;
+        else if (std::strcmp(argv[i], "--no-direct-state-access") == 0)
+            direct_state_access = false;
+        else if (std::strcmp(argv[i], "--no-loader-thread") == 0)
+            loader_thread = false;
+        else if (std::strcmp(argv[i], "--on-demand-rendering") == 0)
+            on_demand_rendering = true;
+        else if (std::strcmp(argv[i], "--gpu-timings-csv") == 0 && i + 1 < argc) {
+            if (!GpuTimer::open_csv(argv[++i]))
+                fprintf(stderr, "Não foi possível criar o arquivo %s\n", argv[i]);
+        }
+        else if (std::strcmp(argv[i], "--min-resolution-scale") == 0 && i + 1 < argc)
+            parse_positive("--min-resolution-scale", argv[++i], min_scale);
+        else if (std::strcmp(argv[i], "--max-resolution-scale") == 0 && i + 1 < argc)
+            parse_positive("--max-resolution-scale", argv[++i], max_scale);
+        else if (std::strcmp(argv[i], "--gpu-frame-target") == 0 && i + 1 < argc)
+            parse_positive("--gpu-frame-target", argv[++i], SceneTarget::target_gpu_time);
+        else if (std::strcmp(argv[i], "--texture-upload-budget") == 0 && i + 1 < argc)
+            GpuProgram::texture_upload_budget = std::strtof(argv[++i], nullptr);
+        else if (std::strcmp(argv[i], "--texture-memory-cap") == 0 && i + 1 < argc)
+            GpuProgram::texture_memory_cap = GLsizeiptr(std::strtol(argv[++i], nullptr, 10)) << 20;
+        else
+            fprintf(stderr, "Argumento desconhecido: %s\n", argv[i]);
+    }
+
+    // A escala é uma fração da resolução da janela, no intervalo (0, 1]
+    if (min_scale > 1.0f || max_scale > 1.0f) {
+        fprintf(stderr, "Escalas de resolução acima de 1 são limitadas a 1\n");
+        min_scale = std::min(min_scale, 1.0f);
+        max_scale = std::min(max_scale, 1.0f);
+    }
+
+    if (min_scale > max_scale)
+        fprintf(stderr, "Escala mínima %.2f maior que a máxima %.2f, mantendo a faixa padrão\n",
+                min_scale, max_scale);
+    else {
+        SceneTarget::min_scale = min_scale;
+        SceneTarget::max_scale = max_scale;
+    }
+
     glfwSetErrorCallback(glfw_error_callback);
 
     int success = glfwInit();
     if (!success)
         std::exit(EXIT_FAILURE);
 
+    Window::request_direct_state_access = direct_state_access;
     std::shared_ptr<Window> window = std::make_shared<Window>("INF01047 - Trabalho Final");
 
     // Desabilita limite de quadros
@@ -63,14 +153,29 @@ int main()
     // Carregamento de todas funções definidas por OpenGL 3.3, utilizando a
     // biblioteca GLAD.
     gladLoadGL(glfwGetProcAddress);
+    GlExtensions::load(glfwGetProcAddress);
+    if (!multi_draw)
+        GlExtensions::multi_draw_indirect = false;
+
+    // Algumas implementações criam um contexto 4.5 mesmo quando 3.3 é pedido
+    if (!direct_state_access)
+        GlExtensions::direct_state_access = false;
+
+    if (loader_thread)
+        GpuLoader::start(window->glfw_window);
+
+    print_system_info(on_demand_rendering);
 
-    print_system_info();
+    if (cold_shader_cache)
+        ProgramCache::clear();
 
     // Inicializamos o código para renderização de texto.
-    TextRendering_Init();
+    TextRendering_Init(window->glfw_window);
 
     std::shared_ptr<GpuProgram> gpu_program = std::make_shared<GpuProgram>();
 
+    ProgramCache::print_stats();
+
     GameStateManager state_manager(window, gpu_program);
     state_manager.push_state(std::make_unique<BaseState>());
 
@@ -78,32 +183,99 @@ int main()
     float current_time;
     float prev_time = (float)glfwGetTime();
 
+    // O tempo de CPU do processo inclui todas as suas threads
+    double report_time = glfwGetTime();
+    std::clock_t report_clock = std::clock();
+    unsigned long frames_drawn = 0;
+
     // Ficamos em um loop infinito, renderizando, até que o usuário feche a janela
     while (!glfwWindowShouldClose(window->glfw_window))
     {
+        // Com a janela minimizada nada é atualizado ou desenhado, até que um
+        // evento a restaure
+        if (window->is_suspended()) {
+            glfwWaitEvents();
+            prev_time = (float)glfwGetTime();
+            continue;
+        }
+
         // Atualiza delta de tempo
         current_time = (float)glfwGetTime();
         dt = current_time - prev_time;
         prev_time = current_time;
 
         state_manager.update(dt);
-        state_manager.draw();
 
-        // O framebuffer onde OpenGL executa as operações de renderização não
-        // é o mesmo que está sendo mostrado para o usuário, caso contrário
-        // seria possível ver artefatos conhecidos como "screen tearing". A
-        // chamada abaixo faz a troca dos buffers, mostrando para o usuário
-        // tudo que foi renderizado pelas funções acima.
-        // Veja o link: https://en.wikipedia.org/w/index.php?title=Multiple_buffering&oldid=793452829#Double_buffering_in_computer_graphics
-        glfwSwapBuffers(window->glfw_window);
+        // Os dois pedidos são consumidos a cada quadro
+        bool redraw = state_manager.consume_redraw_request();
+        bool damaged = window->consume_damage();
+        bool draw = !on_demand_rendering || redraw || damaged;
+
+        if (draw) {
+            state_manager.draw();
+
+            // Todo o texto do quadro é desenhado de uma só vez, por cima da cena
+            GpuTimer::begin("text");
+            TextRendering_Flush();
+            GpuTimer::end();
+
+            GpuProgram::end_frame();
+            GlState::end_frame();
+            Object::end_frame();
+            StreamBuffer::end_frame();
+            GpuTimer::end_frame();
+        }
+
+        // Recursos terminados pela thread de carregamento aparecem a partir
+        // do próximo quadro
+        bool loading = GpuLoader::has_pending_work();
+        GpuLoader::end_frame();
+        if (loading)
+            state_manager.request_redraw();
+
+        if (draw) {
+            // O framebuffer onde OpenGL executa as operações de renderização não
+            // é o mesmo que está sendo mostrado para o usuário, caso contrário
+            // seria possível ver artefatos conhecidos como "screen tearing". A
+            // chamada abaixo faz a troca dos buffers, mostrando para o usuário
+            // tudo que foi renderizado pelas funções acima.
+            // Veja o link: https://en.wikipedia.org/w/index.php?title=Multiple_buffering&oldid=793452829#Double_buffering_in_computer_graphics
+            glfwSwapBuffers(window->glfw_window);
+            frames_drawn++;
+        }
+
+        double seconds = glfwGetTime();
+        if (seconds - report_time >= ACTIVITY_REPORT_INTERVAL) {
+            std::clock_t cpu_clock = std::clock();
+            double cpu_seconds = double(cpu_clock - report_clock) / CLOCKS_PER_SEC;
+            double minutes = (seconds - report_time) / 60.0;
+
+            printf("Atividade: %.1f quadros desenhados por minuto, CPU em %.1f%%\n",
+                   frames_drawn / minutes, 100.0 * cpu_seconds / (seconds - report_time));
+
+            report_time = seconds;
+            report_clock = cpu_clock;
+            frames_drawn = 0;
+        }
 
         // Verificamos com o sistema operacional se houve alguma interação do
         // usuário (teclado, mouse, ...). Caso positivo, as funções de callback
         // definidas anteriormente usando glfwSet*Callback() serão chamadas
-        // pela biblioteca GLFW.
-        glfwPollEvents();
+        // pela biblioteca GLFW. Sem nada para desenhar, esperamos pelo
+        // próximo evento, e o tempo parado não conta para o delta.
+        if (draw) {
+            glfwPollEvents();
+        }
+        else {
+            glfwWaitEventsTimeout(ON_DEMAND_WAIT_TIMEOUT);
+            prev_time = (float)glfwGetTime();
+        }
     }
 
+    // Recursos ainda sendo enviados são descartados
+    GpuLoader::stop();
+    GpuTimer::close_csv();
+
     // Clean up
     while (!state_manager.empty()) {
         state_manager.pop_state();
@@ -129,6 +301,12 @@ void FramebufferSizeCallback(GLFWwindow* window, int width, int height)
     // "Screen Mapping" ou "Viewport Mapping" vista em aula ({+ViewportMapping2+}).
     glViewport(0, 0, width, height);
 
+    // O texto é posicionado a partir do tamanho da janela
+    TextRendering_UpdateWindowSize(window);
+
+    // O conteúdo da janela precisa ser desenhado no novo tamanho
+    Window::mark_damaged();
+
     // Atualizamos também a razão que define a proporção da janela (largura /
     // altura), a qual será utilizada na definição das matrizes de projeção,
     // tal que não ocorra distorções durante o processo de "Screen Mapping"
@@ -139,7 +317,23 @@ void FramebufferSizeCallback(GLFWwindow* window, int width, int height)
     camera->set_aspect_ratio((float)width / height);
 }
 
-void print_system_info()
+// Lê o valor de uma opção, que deve ser um número maior que zero. Valores
+// inválidos são rejeitados com uma mensagem, mantendo o valor padrão.
+bool parse_positive(const char* option, const char* text, float& value)
+{
+    char* end;
+    float parsed = std::strtof(text, &end);
+
+    if (end == text || *end != '\0' || !std::isfinite(parsed) || parsed <= 0.0f) {
+        fprintf(stderr, "Valor inválido para %s: %s\n", option, text);
+        return false;
+    }
+
+    value = parsed;
+    return true;
+}
+
+void print_system_info(bool on_demand_rendering)
 {
     const GLubyte *vendor      = glGetString(GL_VENDOR);
     const GLubyte *renderer    = glGetString(GL_RENDERER);
@@ -147,6 +341,9 @@ void print_system_info()
     const GLubyte *glslversion = glGetString(GL_SHADING_LANGUAGE_VERSION);
 
     printf("GPU: %s, %s, OpenGL %s, GLSL %s\n", vendor, renderer, glversion, glslversion);
+    printf("Direct state access: %s\n", GlExtensions::direct_state_access ? "sim" : "não");
+    printf("Thread de carregamento: %s\n", GpuLoader::is_running() ? "sim" : "não");
+    printf("Renderização sob demanda: %s\n", on_demand_rendering ? "sim" : "não");
 }
 
 // set makeprg=cd\ ..\ &&\ make\ run\ >/dev/null
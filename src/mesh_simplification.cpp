@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include "mesh_simplification.hpp"
+
+// Weight of the planes added along open borders, so that they keep their shape
+#define BORDER_WEIGHT 1000.0
+
+namespace {
+
+// Symmetric 4x4 matrix, only the upper triangle is stored
+struct Quadric {
+    std::array<double, 10> q = {};
+
+    // Quadric of the plane n.p + d = 0
+    Quadric() = default;
+    Quadric(glm::vec3 n, double d, double weight)
+    {
+        double a = n.x, b = n.y, c = n.z;
+        q = {a*a, a*b, a*c, a*d,
+                  b*b, b*c, b*d,
+                       c*c, c*d,
+                            d*d};
+        for (auto& v : q)
+            v *= weight;
+    }
+
+    Quadric& operator+=(const Quadric& other)
+    {
+        for (size_t i = 0; i < q.size(); i++)
+            q[i] += other.q[i];
+        return *this;
+    }
+
+    // Sum of squared distances from p to the planes of the quadric
+    double error(glm::vec3 p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+                        +   q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+                                     +   q[7]*z*z + 2*q[8]*z
+                                                  +   q[9];
+    }
+};
+
+struct Collapse {
+    double cost;
+    uint32_t from;
+    uint32_t to;
+    uint32_t from_version;
+    uint32_t to_version;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+glm::vec3 triangle_normal(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+    return glm::cross(b - a, c - a);
+}
+
+} // namespace
+
+std::vector<std::vector<uint32_t>> simplify_mesh(const std::vector<glm::vec3>& positions,
+                                                 const std::vector<uint32_t>& corner_positions,
+                                                 const std::vector<bool>& locked,
+                                                 std::vector<size_t> target_triangle_counts)
+{
+    size_t num_positions = positions.size();
+    size_t num_triangles = corner_positions.size() / 3;
+
+    // Current position and attribute corner of each triangle corner
+    std::vector<uint32_t> position(corner_positions);
+    std::vector<uint32_t> attribute(corner_positions.size());
+    for (size_t i = 0; i < attribute.size(); i++)
+        attribute[i] = i;
+
+    std::vector<bool> triangle_alive(num_triangles, true);
+    size_t num_alive = num_triangles;
+
+    std::vector<std::vector<uint32_t>> position_triangles(num_positions);
+    std::vector<Quadric> quadrics(num_positions);
+    std::map<std::pair<uint32_t, uint32_t>, int> edge_count;
+
+    for (size_t t = 0; t < num_triangles; t++) {
+        uint32_t v[3] = {position[3*t], position[3*t + 1], position[3*t + 2]};
+
+        // Degenerate triangles are dropped from every level
+        if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0]) {
+            triangle_alive[t] = false;
+            num_alive--;
+            continue;
+        }
+
+        glm::vec3 n = triangle_normal(positions[v[0]], positions[v[1]], positions[v[2]]);
+        double area = glm::length(n);
+
+        for (int i = 0; i < 3; i++) {
+            position_triangles[v[i]].push_back(t);
+            edge_count[std::minmax(v[i], v[(i + 1) % 3])]++;
+        }
+
+        if (area <= 0.0)
+            continue;
+
+        n /= area;
+        Quadric plane(n, -glm::dot(n, positions[v[0]]), area * 0.5);
+        for (int i = 0; i < 3; i++)
+            quadrics[v[i]] += plane;
+    }
+
+    // Planes perpendicular to open borders keep them from shrinking
+    for (size_t t = 0; t < num_triangles; t++) {
+        if (!triangle_alive[t])
+            continue;
+
+        uint32_t v[3] = {position[3*t], position[3*t + 1], position[3*t + 2]};
+        glm::vec3 n = triangle_normal(positions[v[0]], positions[v[1]], positions[v[2]]);
+
+        for (int i = 0; i < 3; i++) {
+            uint32_t a = v[i];
+            uint32_t b = v[(i + 1) % 3];
+            if (edge_count[std::minmax(a, b)] != 1)
+                continue;
+
+            glm::vec3 edge = positions[b] - positions[a];
+            glm::vec3 border_normal = glm::cross(edge, n);
+            double length = glm::length(border_normal);
+            if (length <= 0.0)
+                continue;
+
+            border_normal /= length;
+            Quadric border(border_normal, -glm::dot(border_normal, positions[a]),
+                           BORDER_WEIGHT * glm::dot(edge, edge));
+            quadrics[a] += border;
+            quadrics[b] += border;
+        }
+    }
+
+    std::vector<uint32_t> version(num_positions, 0);
+    std::vector<bool> removed(num_positions, false);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+    auto push_collapse = [&](uint32_t from, uint32_t to) {
+        if (locked[from])
+            return;
+
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        heap.push({q.error(positions[to]), from, to, version[from], version[to]});
+    };
+
+    auto push_neighbours = [&](uint32_t v) {
+        for (uint32_t t : position_triangles[v]) {
+            if (!triangle_alive[t])
+                continue;
+
+            for (int i = 0; i < 3; i++) {
+                uint32_t w = position[3*t + i];
+                if (w != v) {
+                    push_collapse(v, w);
+                    push_collapse(w, v);
+                }
+            }
+        }
+    };
+
+    for (uint32_t v = 0; v < num_positions; v++)
+        push_neighbours(v);
+
+    // Moving "from" onto "to" must not flip any of the remaining triangles
+    auto flips = [&](uint32_t from, uint32_t to) {
+        for (uint32_t t : position_triangles[from]) {
+            if (!triangle_alive[t])
+                continue;
+
+            glm::vec3 p[3];
+            bool has_to = false;
+            for (int i = 0; i < 3; i++) {
+                p[i] = positions[position[3*t + i]];
+                has_to = has_to || position[3*t + i] == to;
+            }
+
+            if (has_to)
+                continue;
+
+            glm::vec3 before = triangle_normal(p[0], p[1], p[2]);
+            for (int i = 0; i < 3; i++)
+                if (position[3*t + i] == from)
+                    p[i] = positions[to];
+            glm::vec3 after = triangle_normal(p[0], p[1], p[2]);
+
+            if (glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+
+        return false;
+    };
+
+    auto collapse = [&](uint32_t from, uint32_t to) {
+        // Remapped corners take the attributes of "to" from a triangle being
+        // removed, which lies on the same side of any seam as "from"
+        uint32_t to_attribute = 0;
+        bool found = false;
+
+        for (uint32_t t : position_triangles[from]) {
+            if (!triangle_alive[t])
+                continue;
+
+            for (int i = 0; i < 3; i++) {
+                if (position[3*t + i] == to) {
+                    to_attribute = attribute[3*t + i];
+                    found = true;
+                    triangle_alive[t] = false;
+                    num_alive--;
+                }
+            }
+        }
+
+        if (!found)
+            return;
+
+        for (uint32_t t : position_triangles[from]) {
+            if (!triangle_alive[t])
+                continue;
+
+            for (int i = 0; i < 3; i++) {
+                if (position[3*t + i] == from) {
+                    position[3*t + i] = to;
+                    attribute[3*t + i] = to_attribute;
+                }
+            }
+
+            position_triangles[to].push_back(t);
+        }
+
+        position_triangles[from].clear();
+        quadrics[to] += quadrics[from];
+        removed[from] = true;
+        version[to]++;
+
+        push_neighbours(to);
+    };
+
+    std::sort(target_triangle_counts.begin(), target_triangle_counts.end(), std::greater<size_t>());
+
+    std::vector<std::vector<uint32_t>> levels;
+
+    for (size_t target : target_triangle_counts) {
+        while (num_alive > target && !heap.empty()) {
+            Collapse c = heap.top();
+            heap.pop();
+
+            if (removed[c.from] || removed[c.to] ||
+                c.from_version != version[c.from] || c.to_version != version[c.to])
+                continue;
+
+            if (flips(c.from, c.to))
+                continue;
+
+            collapse(c.from, c.to);
+        }
+
+        std::vector<uint32_t> indices;
+        indices.reserve(3 * num_alive);
+
+        for (size_t t = 0; t < num_triangles; t++) {
+            if (!triangle_alive[t])
+                continue;
+
+            for (int i = 0; i < 3; i++)
+                indices.push_back(attribute[3*t + i]);
+        }
+
+        levels.push_back(std::move(indices));
+    }
+
+    return levels;
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
 
 #include <glad/gl.h>
@@ -8,6 +10,55 @@
 
 #include "object.hpp"
 #include "gpu.hpp"
+#include "gl_extensions.hpp"
+#include "gl_state.hpp"
+#include "gpu_loader.hpp"
+#include "mesh_simplification.hpp"
+
+// Screen size below which each coarser level of detail is used, as the
+// radius of the instance over half the screen height
+static const float lod_thresholds[MAX_LODS - 1] = {0.08f, 0.04f, 0.02f};
+
+// Fraction by which the screen size must pass a threshold before the level
+// changes, so that instances near a threshold do not pop back and forth
+#define LOD_HYSTERESIS 0.15f
+
+// Cria um buffer preenchido com dados que não mudam depois. Sem acesso direto
+// ao estado, o buffer é ligado ao alvo indicado.
+static GLuint create_static_buffer(GLenum target, GLsizeiptr size, const void* data)
+{
+    GLuint buffer_id;
+
+    if (GlExtensions::direct_state_access) {
+        glCreateBuffers(1, &buffer_id);
+        glNamedBufferStorage(buffer_id, size, data, 0);
+        return buffer_id;
+    }
+
+    glGenBuffers(1, &buffer_id);
+    GlState::bind_buffer(target, buffer_id);
+    glBufferData(target, size, data, GL_STATIC_DRAW);
+    GlState::bind_buffer(target, 0);
+    return buffer_id;
+}
+
+// Associa um buffer com os coeficientes de um atributo à localização de mesmo
+// número no VAO. Sem acesso direto ao estado, o VAO deve estar ligado.
+static void add_vertex_attribute(GLuint vao_id, GLuint location, GLint number_of_dimensions, GLuint buffer_id)
+{
+    if (GlExtensions::direct_state_access) {
+        glVertexArrayVertexBuffer(vao_id, location, buffer_id, 0, number_of_dimensions * sizeof(float));
+        glVertexArrayAttribFormat(vao_id, location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(vao_id, location, location);
+        glEnableVertexArrayAttrib(vao_id, location);
+        return;
+    }
+
+    GlState::bind_buffer(GL_ARRAY_BUFFER, buffer_id);
+    glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(location);
+    GlState::bind_buffer(GL_ARRAY_BUFFER, 0);
+}
 
 ObjModel::ObjModel(std::string inputfile, std::string mtl_search_path, bool triangulate)
 {
@@ -45,6 +96,8 @@ ObjModel::ObjModel(std::string inputfile, std::string mtl_search_path, bool tria
 
     compute_normals();
     build_triangles();
+    build_lods();
+    upload_geometry();
 }
 
 void ObjModel::compute_normals()
@@ -112,9 +165,6 @@ void ObjModel::compute_normals()
 
 void ObjModel::build_triangles()
 {
-    glGenVertexArrays(1, &vao_id);
-    glBindVertexArray(vao_id);
-
     std::vector<GLuint> indices;
     std::vector<float>  model_coefficients;
     std::vector<float>  normal_coefficients;
@@ -218,83 +268,285 @@ void ObjModel::build_triangles()
 
     num_indices = indices.size();
 
-    GLuint VBO_model_coefficients_id;
-    glGenBuffers(1, &VBO_model_coefficients_id);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_model_coefficients_id);
-    glBufferData(GL_ARRAY_BUFFER, model_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, model_coefficients.size() * sizeof(float), model_coefficients.data());
-    GLuint location = 0; // "(location = 0)" em "shader_vertex.glsl"
-    GLint  number_of_dimensions = 4; // vec4 em "shader_vertex.glsl"
-    glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(location);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Com multi-draw indirect, os vértices de todos os modelos são
+    // intercalados em um único buffer compartilhado
+    if (GeometryPool::is_enabled())
+    {
+        size_t num_vertices = model_coefficients.size() / 4;
+        std::vector<PoolVertex> vertices(num_vertices);
+
+        for (size_t i = 0; i < num_vertices; i++)
+        {
+            // Atributos ausentes têm o valor padrão de OpenGL, (0,0,0,1)
+            PoolVertex& v = vertices[i];
+            v.position = glm::make_vec4(&model_coefficients[4*i]);
+            v.normal = normal_coefficients.empty() ? glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
+                                                   : glm::make_vec4(&normal_coefficients[4*i]);
+            v.texcoords = texture_coefficients.empty() ? glm::vec2(0.0f)
+                                                       : glm::make_vec2(&texture_coefficients[2*i]);
+            v.tangent = tangent_coefficients.empty() ? glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
+                                                     : glm::make_vec4(&tangent_coefficients[4*i]);
+        }
+
+        vao_id = GeometryPool::get_vao();
+        base_vertex = GeometryPool::add_vertices(vertices);
+        lods = {{GeometryPool::add_indices(indices), (GLsizei)num_indices}};
+        return;
+    }
+
+    // Os buffers são criados por upload_geometry(), depois que os níveis de
+    // detalhe são adicionados aos índices
+    geometry = std::make_shared<ModelGeometry>();
+    geometry->model_coefficients = std::move(model_coefficients);
+    geometry->normal_coefficients = std::move(normal_coefficients);
+    geometry->texture_coefficients = std::move(texture_coefficients);
+    geometry->tangent_coefficients = std::move(tangent_coefficients);
+    geometry->indices = std::move(indices);
+
+    lods = {{0, (GLsizei)num_indices}};
+}
+
+void ObjModel::upload_geometry()
+{
+    // No buffer compartilhado os dados já foram enviados, e o modelo pode ser
+    // desenhado quando todos os envios anteriores terminarem
+    if (GeometryPool::is_enabled())
+    {
+        if (!GpuLoader::is_running())
+        {
+            uploaded = true;
+            return;
+        }
+
+        std::weak_ptr<bool> alive = lifetime;
+        GpuLoader::submit(nullptr, [this, alive]() {
+            if (!alive.expired())
+                uploaded = true;
+        });
+        return;
+    }
 
-    if ( !normal_coefficients.empty() )
+    if (!GpuLoader::is_running())
     {
-        GLuint VBO_normal_coefficients_id;
-        glGenBuffers(1, &VBO_normal_coefficients_id);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_normal_coefficients_id);
-        glBufferData(GL_ARRAY_BUFFER, normal_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, normal_coefficients.size() * sizeof(float), normal_coefficients.data());
-        location = 1; // "(location = 1)" em "shader_vertex.glsl"
-        number_of_dimensions = 4; // vec4 em "shader_vertex.glsl"
-        glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-    }
-
-    if ( !texture_coefficients.empty() )
+        create_buffers(*geometry);
+        create_vertex_array();
+        return;
+    }
+
+    // VAOs não são compartilhados entre contextos, então apenas os buffers
+    // são criados pela thread de carregamento
+    std::weak_ptr<bool> alive = lifetime;
+    GpuLoader::submit([geometry = geometry]() { create_buffers(*geometry); },
+                      [this, alive]() {
+                          if (!alive.expired())
+                              create_vertex_array();
+                      });
+}
+
+void ObjModel::create_buffers(ModelGeometry& geometry)
+{
+    // Os locais dos atributos são os de "shader_vertex.glsl", usados em
+    // create_vertex_array()
+    const std::array<const std::vector<float>*, 4> coefficients = {
+        &geometry.model_coefficients,
+        &geometry.normal_coefficients,
+        &geometry.texture_coefficients,
+        &geometry.tangent_coefficients,
+    };
+
+    for (size_t location = 0; location < coefficients.size(); location++)
     {
-        GLuint VBO_texture_coefficients_id;
-        glGenBuffers(1, &VBO_texture_coefficients_id);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_texture_coefficients_id);
-        glBufferData(GL_ARRAY_BUFFER, texture_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, texture_coefficients.size() * sizeof(float), texture_coefficients.data());
-        location = 2; // "(location = 2)" em "shader_vertex.glsl"
-        number_of_dimensions = 2; // vec2 em "shader_vertex.glsl"
-        glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-    }
-
-    if ( !tangent_coefficients.empty() )
+        const std::vector<float>& c = *coefficients[location];
+        if ( !c.empty() )
+            geometry.attribute_buffer_ids[location] = create_static_buffer(GL_ARRAY_BUFFER, c.size() * sizeof(float), c.data());
+    }
+
+    // O buffer de índices é associado ao VAO depois, então ele é ligado
+    // aqui como um buffer qualquer
+    geometry.indices_id = create_static_buffer(GL_COPY_WRITE_BUFFER, geometry.indices.size() * sizeof(GLuint),
+                                               geometry.indices.data());
+}
+
+void ObjModel::create_vertex_array()
+{
+    // Dimensões de cada atributo, vec4 ou vec2 em "shader_vertex.glsl"
+    const GLint number_of_dimensions[4] = {4, 4, 2, 4};
+
+    bool bind = !GlExtensions::direct_state_access;
+    if (bind)
+    {
+        glGenVertexArrays(1, &vao_id);
+        GlState::bind_vertex_array(vao_id);
+    }
+    else
+    {
+        glCreateVertexArrays(1, &vao_id);
+    }
+
+    for (GLuint location = 0; location < 4; location++)
+    {
+        GLuint buffer_id = geometry->attribute_buffer_ids[location];
+        if (buffer_id != 0)
+            add_vertex_attribute(vao_id, location, number_of_dimensions[location], buffer_id);
+    }
+
+    enable_instance_attributes(vao_id);
+
+    indices_id = geometry->indices_id;
+    if (bind)
+    {
+        // O buffer de índices ligado com o VAO passa a fazer parte do seu estado
+        GlState::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, indices_id);
+
+        // "Desligamos" o VAO, evitando assim que operações posteriores venham a
+        // alterar o mesmo. Isso evita bugs.
+        GlState::bind_vertex_array(0);
+    }
+    else
+    {
+        glVertexArrayElementBuffer(vao_id, indices_id);
+    }
+
+    geometry.reset();
+    uploaded = true;
+}
+
+void ObjModel::enable_instance_attributes(GLuint vao_id)
+{
+    // Matrizes de modelagem e de normais de cada instância, "(location = 4)"
+    // e "(location = 8)" em "shader_vertex.glsl". Um atributo matricial ocupa
+    // uma localização por coluna, e estes avançam uma vez por instância.
+    // O buffer com as matrizes é associado em set_instance_buffer().
+    if (GlExtensions::direct_state_access)
+    {
+        // Todas as colunas são lidas de um só ponto de associação, cujo
+        // buffer e deslocamento mudam sem redefinir o formato dos atributos
+        for (GLuint i = 0; i < 4; i++)
+        {
+            GLuint location = INSTANCE_TRANSFORM_LOCATION + i;
+            glVertexArrayAttribFormat(vao_id, location, 4, GL_FLOAT, GL_FALSE,
+                                      offsetof(InstanceData, model) + i * sizeof(glm::vec4));
+            glVertexArrayAttribBinding(vao_id, location, INSTANCE_BUFFER_BINDING);
+            glEnableVertexArrayAttrib(vao_id, location);
+        }
+        for (GLuint i = 0; i < 3; i++)
+        {
+            GLuint location = INSTANCE_NORMAL_MATRIX_LOCATION + i;
+            glVertexArrayAttribFormat(vao_id, location, 3, GL_FLOAT, GL_FALSE,
+                                      offsetof(InstanceData, normal_matrix) + i * sizeof(glm::vec3));
+            glVertexArrayAttribBinding(vao_id, location, INSTANCE_BUFFER_BINDING);
+            glEnableVertexArrayAttrib(vao_id, location);
+        }
+        glVertexArrayBindingDivisor(vao_id, INSTANCE_BUFFER_BINDING, 1);
+        return;
+    }
+
+    for (GLuint i = 0; i < 4; i++)
+    {
+        glEnableVertexAttribArray(INSTANCE_TRANSFORM_LOCATION + i);
+        glVertexAttribDivisor(INSTANCE_TRANSFORM_LOCATION + i, 1);
+    }
+    for (GLuint i = 0; i < 3; i++)
+    {
+        glEnableVertexAttribArray(INSTANCE_NORMAL_MATRIX_LOCATION + i);
+        glVertexAttribDivisor(INSTANCE_NORMAL_MATRIX_LOCATION + i, 1);
+    }
+}
+
+void ObjModel::set_instance_buffer(GLuint vao_id, GLuint instance_vbo_id, size_t offset)
+{
+    if (GlExtensions::direct_state_access)
+    {
+        glVertexArrayVertexBuffer(vao_id, INSTANCE_BUFFER_BINDING, instance_vbo_id, offset, sizeof(InstanceData));
+        return;
+    }
+
+    GlState::bind_buffer(GL_ARRAY_BUFFER, instance_vbo_id);
+    for (GLuint i = 0; i < 4; i++)
+        glVertexAttribPointer(INSTANCE_TRANSFORM_LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(offset + offsetof(InstanceData, model) + i * sizeof(glm::vec4)));
+    for (GLuint i = 0; i < 3; i++)
+        glVertexAttribPointer(INSTANCE_NORMAL_MATRIX_LOCATION + i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(offset + offsetof(InstanceData, normal_matrix) + i * sizeof(glm::vec3)));
+}
+
+void ObjModel::build_lods()
+{
+    size_t num_triangles = num_indices / 3;
+    if (num_triangles < LOD_MIN_TRIANGLES)
+        return;
+
+    std::vector<glm::vec3> positions(attrib.vertices.size() / 3);
+    for (size_t i = 0; i < positions.size(); i++)
+        positions[i] = glm::vec3(attrib.vertices[3*i + 0],
+                                 attrib.vertices[3*i + 1],
+                                 attrib.vertices[3*i + 2]);
+
+    // Position of each corner, in the same order as the vertices created by
+    // build_triangles(). Positions whose corners have different normals or
+    // texture coordinates lie on a seam and are kept.
+    std::vector<uint32_t> corner_positions;
+    std::vector<std::pair<int, int>> position_attributes(positions.size(), {-2, -2});
+    std::vector<bool> locked(positions.size(), false);
+
+    for (size_t shape = 0; shape < shapes.size(); ++shape)
     {
-        GLuint VBO_tangent_coefficients_id;
-        glGenBuffers(1, &VBO_tangent_coefficients_id);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_tangent_coefficients_id);
-        glBufferData(GL_ARRAY_BUFFER, tangent_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, tangent_coefficients.size() * sizeof(float), tangent_coefficients.data());
-        location = 3; // "(location = 3)" em "shader_vertex.glsl"
-        number_of_dimensions = 4; // vec4 em "shader_vertex.glsl"
-        glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        for (const tinyobj::index_t& idx : shapes[shape].mesh.indices)
+        {
+            corner_positions.push_back(idx.vertex_index);
+
+            std::pair<int, int> attributes(idx.normal_index, idx.texcoord_index);
+            auto& first = position_attributes[idx.vertex_index];
+
+            if (first.first == -2)
+                first = attributes;
+            else if (first != attributes)
+                locked[idx.vertex_index] = true;
+        }
     }
 
-    GLuint indices_id;
-    glGenBuffers(1, &indices_id);
+    std::vector<size_t> targets;
+    for (size_t level = 1; level < MAX_LODS; level++)
+        targets.push_back(num_triangles >> level);
+
+    std::vector<std::vector<uint32_t>> levels = simplify_mesh(positions, corner_positions, locked, targets);
 
-    // "Ligamos" o buffer. Note que o tipo agora é GL_ELEMENT_ARRAY_BUFFER.
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(GLuint), indices.data());
-    // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); // XXX Errado!
-    //
+    for (const auto& level : levels) {
+        // Levels that could barely be simplified are not worth a switch
+        if (level.size() > 0.9f * lods.back().num_indices)
+            break;
+
+        // In the geometry pool each level is appended on its own
+        if (GeometryPool::is_enabled()) {
+            lods.push_back({GeometryPool::add_indices(level), (GLsizei)level.size()});
+            continue;
+        }
 
-    // "Desligamos" o VAO, evitando assim que operações posteriores venham a
-    // alterar o mesmo. Isso evita bugs.
-    glBindVertexArray(0);
+        // Otherwise the levels follow the full mesh, before the index buffer
+        // is created
+        std::vector<GLuint>& indices = geometry->indices;
+        lods.push_back({(GLuint)indices.size(), (GLsizei)level.size()});
+        indices.insert(indices.end(), level.begin(), level.end());
+    }
 }
 
-void ObjModel::draw(GpuProgram& gpu_program)
+void ObjModel::draw(GpuProgram& gpu_program, GLuint instance_vbo_id,
+                    GLint first_instance, GLsizei num_instances, size_t lod)
 {
-    glUseProgram(gpu_program.id);
-    glBindVertexArray(vao_id);
+    gpu_program.use();
+    GlState::bind_vertex_array(vao_id);
+
+    // Aponta os atributos por instância para o buffer do Object sendo
+    // desenhado, a partir da primeira instância do grupo. OpenGL 3.3 não
+    // possui glDrawElementsInstancedBaseInstance.
+    set_instance_buffer(vao_id, instance_vbo_id, first_instance * sizeof(InstanceData));
 
-    glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_INT, 0);
+    // O vértice base é diferente de zero apenas no buffer compartilhado
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lods[lod].num_indices, GL_UNSIGNED_INT,
+                                      (void*)(lods[lod].first_index * sizeof(GLuint)),
+                                      num_instances, base_vertex);
 
-    glBindVertexArray(0);
-    glUseProgram(0);
+    Object::render_stats.draw_calls++;
 }
 
 // Função para debugging: imprime no terminal todas informações de um modelo
@@ -468,27 +720,184 @@ Object::Object(std::shared_ptr<ObjModel> m, GpuProgram& gpu) : gpu_program(gpu)
     add_instance(Matrix_Identity());
 }
 
-void Object::draw(const glm::mat4 parent_transform)
+Object::RenderStats Object::render_stats;
+Object::RenderStats Object::render_stats_last_frame;
+bool Object::frustum_culling = true;
+
+void Object::end_frame()
+{
+    render_stats_last_frame = render_stats;
+    render_stats = RenderStats();
+}
+
+// Chooses the level of detail of an instance from its size on the screen
+static size_t select_lod(float screen_size, size_t current_lod, size_t num_lods)
+{
+    size_t lod = 0;
+    while (lod + 1 < num_lods && screen_size < lod_thresholds[lod])
+        lod++;
+
+    // The level only changes once the size is past the threshold by a margin
+    while (lod > current_lod && screen_size >= lod_thresholds[lod - 1] * (1.0f - LOD_HYSTERESIS))
+        lod--;
+    while (lod < current_lod && screen_size <= lod_thresholds[lod] * (1.0f + LOD_HYSTERESIS))
+        lod++;
+
+    return lod;
+}
+
+void Object::collect(RenderQueue& queue, const ViewInfo& view, glm::mat4 parent_transform)
 {
+    for (auto& instances : visible_instances)
+        instances.clear();
+
+    for (size_t i = 0; i < num_instances; i++) {
+        if (inactive_instances[i])
+            continue;
+
+        AABB aabb = transform_aabb(model->aabb, parent_transform * transforms[i]);
+
+        if (frustum_culling && !view.frustum.intersects(aabb)) {
+            render_stats.instances_culled++;
+            continue;
+        }
+
+        glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+        float radius = glm::length(aabb.max - aabb.min) * 0.5f;
+        float screen_size = radius * view.projection_scale;
+
+        if (view.perspective)
+            screen_size /= std::max(glm::length(center - glm::vec3(view.camera_position)), 1e-4f);
+
+        instance_lods[i] = select_lod(screen_size, instance_lods[i], model->lods.size());
+        visible_instances[instance_lods[i]].push_back(i);
+    }
+
+    if (instances_dirty || parent_transform != computed_parent_transform ||
+        visible_instances != computed_instances)
+        compute_instances(parent_transform);
+
+    // Models still being sent by the loader thread are not drawn yet, their
+    // children may already be
+    bool drawn = model->uploaded && num_visible_instances > 0;
+
+    if (drawn)
+        instance_allocation = StreamBuffer::write(instance_data.data(),
+                                                  num_visible_instances * sizeof(InstanceData),
+                                                  sizeof(InstanceData));
+
+    // Children are positioned relative to the last active instance
     glm::mat4 t = parent_transform;
-    for (size_t i=0; i<num_instances; i++) {
+    for (size_t i = num_instances; i-- > 0; ) {
         if (!inactive_instances[i]) {
             t = parent_transform * transforms[i];
+            break;
+        }
+    }
 
-            apply_uniforms();
+    if (drawn) {
+        // The depth used for sorting is the distance from the camera to the
+        // origin of the last active instance, relative to the far plane
+        float depth = glm::length(glm::vec3(t[3]) - glm::vec3(view.camera_position)) / 100.0f;
 
-            // Always set model matrix
-            gpu_program.set_uniform("model", t);
+        queue.push(render_pass, gpu_program.id, model->vao_id, material, depth, this);
 
-            model->draw(gpu_program);
+        render_stats.instances_drawn += num_visible_instances;
+        for (size_t lod = 0; lod < model->lods.size(); lod++) {
+            GLuint count = computed_instances[lod].size();
+            if (count == 0)
+                continue;
+
+            render_stats.triangles_drawn += count * model->lods[lod].num_indices / 3;
+            render_stats.triangles_without_lod += count * model->lods[0].num_indices / 3;
         }
     }
 
+    // Children are culled on their own, they may be visible when the parent is not
     for (auto& child : children) {
-        child->draw(t);
+        child->collect(queue, view, t);
     }
 }
 
+void Object::draw_instances(bool apply)
+{
+    if (apply)
+        apply_uniforms();
+
+    draw_lods(gpu_program);
+}
+
+void Object::draw_depth(GpuProgram& depth_program)
+{
+    draw_lods(depth_program);
+}
+
+void Object::draw_lods(GpuProgram& program)
+{
+    // Instances of each level of detail are drawn with a single instanced draw call
+    GLint first_instance = instance_allocation.offset / sizeof(InstanceData);
+    for (size_t lod = 0; lod < model->lods.size(); lod++) {
+        GLsizei count = computed_instances[lod].size();
+        if (count == 0)
+            continue;
+
+        model->draw(program, instance_allocation.buffer_id, first_instance, count, lod);
+        first_instance += count;
+    }
+}
+
+void Object::append_draw_commands(std::vector<DrawElementsIndirectCommand>& commands) const
+{
+    // The allocation is aligned to the size of an instance
+    GLuint first_instance = instance_allocation.offset / sizeof(InstanceData);
+    for (size_t lod = 0; lod < model->lods.size(); lod++) {
+        GLuint count = computed_instances[lod].size();
+        if (count == 0)
+            continue;
+
+        DrawElementsIndirectCommand command;
+        command.count = model->lods[lod].num_indices;
+        command.instance_count = count;
+        command.first_index = model->lods[lod].first_index;
+        command.base_vertex = model->base_vertex;
+        command.base_instance = first_instance;
+        commands.push_back(command);
+
+        first_instance += count;
+    }
+}
+
+GLuint Object::get_instance_buffer() const
+{
+    return instance_allocation.buffer_id;
+}
+
+void Object::compute_instances(glm::mat4 parent_transform)
+{
+    // Only visible instances are sent to the GPU, compacted in a contiguous
+    // array, in order of level of detail
+    instance_data.clear();
+    instance_data.reserve(num_instances);
+
+    for (const auto& lod_instances : visible_instances) {
+        for (GLuint i : lod_instances) {
+            InstanceData instance;
+            instance.model = parent_transform * transforms[i];
+
+            // Normals are transformed by the inverse transpose of the model matrix
+            instance.normal_matrix = glm::inverse(glm::transpose(glm::mat3(instance.model)));
+
+            instance_data.push_back(instance);
+        }
+    }
+
+    num_visible_instances = instance_data.size();
+
+    computed_parent_transform = parent_transform;
+    computed_instances = visible_instances;
+    instances_dirty = false;
+}
+
 void Object::add_child(std::shared_ptr<Object> child)
 {
     children.push_back(child);
@@ -499,11 +908,17 @@ void Object::add_instance(glm::mat4 t)
     transforms.push_back(t);
     num_instances += 1;
     inactive_instances.push_back(false);
+    instance_lods.push_back(0);
+    instances_dirty = true;
 }
 
 void Object::deactivate_instance(int instance_id)
 {
+    if (inactive_instances[instance_id])
+        return;
+
     inactive_instances[instance_id] = true;
+    instances_dirty = true;
 }
 
 bool Object::is_active(int instance_id)
@@ -514,18 +929,66 @@ bool Object::is_active(int instance_id)
 void Object::set_transform(int instance_id, glm::mat4 t)
 {
     transforms[instance_id] = t;
+
+    if (!inactive_instances[instance_id])
+        instances_dirty = true;
 }
 
 void Object::set_uniform(std::string_view name, UniformValue value)
 {
-    uniforms[name.data()] = value;
+    GLint handle = gpu_program.get_uniform_handle(name);
+
+    auto it = std::find_if(uniforms.begin(), uniforms.end(),
+                           [handle](const auto& u) { return u.first == handle; });
+
+    if (it != uniforms.end())
+        it->second = value;
+    else
+        uniforms.emplace_back(handle, value);
+
+    update_material();
 }
 
 void Object::apply_uniforms()
 {
-    for (const auto& [name, value] : uniforms) {
+    for (const auto& [handle, value] : uniforms) {
         std::visit([&](auto&& v) {
-            gpu_program.set_uniform(name, v);
+            gpu_program.set_uniform(handle, v);
         }, value);
     }
 }
+
+void Object::update_material()
+{
+    // FNV-1a over the uniform handles and the raw bytes of their values
+    uint32_t hash = 2166136261u;
+    auto combine = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+    };
+
+    for (const auto& [handle, value] : uniforms) {
+        combine(&handle, sizeof(handle));
+        std::visit([&](auto&& v) { combine(&v, sizeof(v)); }, value);
+    }
+
+    material = uint16_t(hash ^ (hash >> 16));
+}
+
+void Object::set_render_pass(RenderPass pass)
+{
+    render_pass = pass;
+}
+
+GpuProgram& Object::get_gpu_program() const
+{
+    return gpu_program;
+}
+
+bool Object::has_same_uniforms(const Object& other) const
+{
+    return uniforms == other.uniforms;
+}
@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "program_cache.hpp"
+#include "gl_extensions.hpp"
+
+GLuint ProgramCache::hits = 0;
+GLuint ProgramCache::misses = 0;
+GLuint ProgramCache::rejected = 0;
+double ProgramCache::build_seconds = 0.0;
+
+// 64-bit FNV-1a, stable across runs and platforms, unlike std::hash
+static uint64_t fnv1a(uint64_t hash, const std::string& data)
+{
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+
+    // Separates consecutive strings, so that "ab" + "c" differs from "a" + "bc"
+    hash ^= 0xff;
+    hash *= 0x100000001b3ull;
+
+    return hash;
+}
+
+void ProgramCache::clear()
+{
+    std::error_code error;
+    std::filesystem::remove_all(PROGRAM_CACHE_DIRECTORY, error);
+}
+
+uint64_t ProgramCache::key(const std::string& vertex_source, const std::string& fragment_source)
+{
+    // Binaries are only valid for the driver version that created them
+    const char* vendor   = (const char*)glGetString(GL_VENDOR);
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    const char* version  = (const char*)glGetString(GL_VERSION);
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = fnv1a(hash, vertex_source);
+    hash = fnv1a(hash, fragment_source);
+    hash = fnv1a(hash, vendor ? vendor : "");
+    hash = fnv1a(hash, renderer ? renderer : "");
+    hash = fnv1a(hash, version ? version : "");
+
+    return hash;
+}
+
+std::string ProgramCache::path(uint64_t key)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+
+    return std::string(PROGRAM_CACHE_DIRECTORY) + name;
+}
+
+bool ProgramCache::load(uint64_t key, GLuint program_id)
+{
+    if (!GlExtensions::program_binary)
+        return false;
+
+    std::ifstream file(path(key), std::ios::binary);
+    if (!file) {
+        misses++;
+        return false;
+    }
+
+    GLenum format = 0;
+    file.read((char*)&format, sizeof(format));
+
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (!file || binary.empty()) {
+        misses++;
+        return false;
+    }
+
+    glProgramBinary(program_id, format, binary.data(), binary.size());
+
+    // Drivers reject binaries from other versions even when the key matches,
+    // in which case the program is compiled again and the file replaced
+    GLint linked_ok = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &linked_ok);
+
+    if (linked_ok == GL_FALSE) {
+        rejected++;
+        return false;
+    }
+
+    hits++;
+    return true;
+}
+
+void ProgramCache::store(uint64_t key, GLuint program_id)
+{
+    if (!GlExtensions::program_binary)
+        return;
+
+    GLint linked_ok = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &linked_ok);
+
+    GLint length = 0;
+    glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    if (linked_ok == GL_FALSE || length <= 0)
+        return;
+
+    GLenum format = 0;
+    std::vector<char> binary(length);
+    glGetProgramBinary(program_id, length, &length, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(PROGRAM_CACHE_DIRECTORY, error);
+
+    std::ofstream file(path(key), std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "ProgramCache: Cannot write " << path(key) << std::endl;
+        return;
+    }
+
+    file.write((const char*)&format, sizeof(format));
+    file.write(binary.data(), length);
+}
+
+void ProgramCache::print_stats()
+{
+    if (!GlExtensions::program_binary) {
+        printf("Programas de GPU compilados em %.1f ms (cache de binários indisponível)\n",
+               1000.0 * build_seconds);
+        return;
+    }
+
+    printf("Programas de GPU prontos em %.1f ms: %u do cache, %u compilados (%u binários rejeitados)\n",
+           1000.0 * build_seconds, hits, misses + rejected, rejected);
+}
@@ -0,0 +1,288 @@
+#include <algorithm>
+
+#include <glad/gl.h>
+
+#include "render_queue.hpp"
+#include "object.hpp"
+#include "gpu.hpp"
+#include "gl_state.hpp"
+#include "gl_extensions.hpp"
+#include "gpu_timer.hpp"
+
+#define PASS_BITS     2
+#define PROGRAM_BITS  8
+#define VAO_BITS      12
+#define MATERIAL_BITS 16
+#define DEPTH_BITS    26
+
+#define MASK(bits) ((uint64_t(1) << (bits)) - 1)
+
+void RenderQueue::clear()
+{
+    items.clear();
+}
+
+size_t RenderQueue::size()
+{
+    return items.size();
+}
+
+uint64_t RenderQueue::make_key(RenderPass pass, GLuint program_id, GLuint vao_id,
+                               uint16_t material, float depth)
+{
+    uint64_t p = uint64_t(pass) & MASK(PASS_BITS);
+    uint64_t program = uint64_t(program_id) & MASK(PROGRAM_BITS);
+    uint64_t vao = uint64_t(vao_id) & MASK(VAO_BITS);
+    uint64_t m = uint64_t(material) & MASK(MATERIAL_BITS);
+    uint64_t d = uint64_t(std::clamp(depth, 0.0f, 1.0f) * MASK(DEPTH_BITS));
+
+    uint64_t key = p << (64 - PASS_BITS);
+
+    if (pass == RenderPass::BLENDED) {
+        // Back to front: farther items first, state only breaks ties
+        key |= (MASK(DEPTH_BITS) - d) << (PROGRAM_BITS + VAO_BITS + MATERIAL_BITS);
+        key |= program << (VAO_BITS + MATERIAL_BITS);
+        key |= vao << MATERIAL_BITS;
+        key |= m;
+    }
+    else {
+        // Grouped by state, front to back inside each group
+        key |= program << (VAO_BITS + MATERIAL_BITS + DEPTH_BITS);
+        key |= vao << (MATERIAL_BITS + DEPTH_BITS);
+        key |= m << DEPTH_BITS;
+        key |= d;
+    }
+
+    return key;
+}
+
+RenderPass RenderQueue::get_pass(uint64_t key)
+{
+    return RenderPass(key >> (64 - PASS_BITS));
+}
+
+void RenderQueue::push(RenderPass pass, GLuint program_id, GLuint vao_id,
+                       uint16_t material, float depth, Object* object)
+{
+    items.push_back({make_key(pass, program_id, vao_id, material, depth), object, nullptr});
+}
+
+void RenderQueue::push_fullscreen(RenderPass pass, GpuProgram& program)
+{
+    items.push_back({make_key(pass, program.id, 0, 0, 1.0f), nullptr, &program});
+}
+
+void RenderQueue::set_depth_prepass(GpuProgram* depth_program)
+{
+    depth_prepass_program = depth_program;
+}
+
+void RenderQueue::set_pass_state(RenderPass pass)
+{
+    switch (pass) {
+        case RenderPass::BACKGROUND:
+            GlState::disable(GL_DEPTH_TEST);
+            GlState::disable(GL_CULL_FACE);
+            GlState::disable(GL_BLEND);
+            GlState::depth_mask(GL_TRUE);
+            break;
+
+        case RenderPass::OPAQUE:
+            GlState::enable(GL_DEPTH_TEST);
+            GlState::enable(GL_CULL_FACE);
+            GlState::disable(GL_BLEND);
+
+            // After the pre-pass only the nearest surface of each pixel passes
+            if (depth_prepass_program) {
+                GlState::depth_func(GL_LEQUAL);
+                GlState::depth_mask(GL_FALSE);
+            }
+            else {
+                GlState::depth_func(GL_LESS);
+                GlState::depth_mask(GL_TRUE);
+            }
+            break;
+
+        case RenderPass::BACKDROP:
+            GlState::enable(GL_DEPTH_TEST);
+            GlState::disable(GL_CULL_FACE);
+            GlState::disable(GL_BLEND);
+            GlState::depth_func(GL_LEQUAL);
+            GlState::depth_mask(GL_FALSE);
+            break;
+
+        case RenderPass::BLENDED:
+            GlState::enable(GL_DEPTH_TEST);
+            GlState::enable(GL_CULL_FACE);
+            GlState::enable(GL_BLEND);
+            GlState::depth_func(GL_LESS);
+            GlState::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            GlState::depth_mask(GL_FALSE);
+            break;
+    }
+}
+
+void RenderQueue::submit()
+{
+    std::sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) {
+        return a.key < b.key;
+    });
+
+    batches.clear();
+    if (GeometryPool::is_enabled())
+        build_batches();
+
+    if (depth_prepass_program)
+        draw_depth_prepass();
+
+    const Object* previous = nullptr;
+    const GpuProgram* timed_program = nullptr;
+    bool first = true;
+    RenderPass pass = RenderPass::BACKGROUND;
+    size_t next_batch = 0;
+
+    for (size_t i = 0; i < items.size(); i++) {
+        const DrawItem& item = items[i];
+        RenderPass item_pass = get_pass(item.key);
+        if (first || item_pass != pass) {
+            set_pass_state(item_pass);
+            pass = item_pass;
+            first = false;
+        }
+
+        // Items of a program are next to each other within a pass, so each
+        // run of them is timed as one scope
+        const GpuProgram* program = item.object ? &item.object->get_gpu_program() : item.program;
+        if (program != timed_program) {
+            GpuTimer::begin(program->timer_scope);
+            timed_program = program;
+        }
+
+        if (!item.object) {
+            if (empty_vao_id == 0)
+                glGenVertexArrays(1, &empty_vao_id);
+
+            item.program->use();
+            GlState::bind_vertex_array(empty_vao_id);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            previous = nullptr;
+            continue;
+        }
+
+        // Consecutive objects with the same program and uniform values
+        // do not need to apply their uniforms again
+        bool same_material = previous &&
+                             &previous->get_gpu_program() == &item.object->get_gpu_program() &&
+                             previous->has_same_uniforms(*item.object);
+
+        if (next_batch < batches.size() && batches[next_batch].first_item == i) {
+            const MultiDrawBatch& batch = batches[next_batch++];
+
+            if (!same_material)
+                item.object->apply_uniforms();
+            draw_batch(batch, item.object->get_gpu_program());
+
+            i += batch.num_items - 1;
+            previous = items[i].object;
+            continue;
+        }
+
+        item.object->draw_instances(!same_material);
+
+        previous = item.object;
+    }
+
+    GpuTimer::end();
+
+    // Leaves the default state for opaque geometry and UI drawn afterwards
+    GlState::depth_func(GL_LESS);
+    GlState::depth_mask(GL_TRUE);
+    GlState::disable(GL_BLEND);
+    GlState::enable(GL_DEPTH_TEST);
+}
+
+void RenderQueue::draw_depth_prepass()
+{
+    GpuTimer::begin("depth prepass");
+
+    GlState::enable(GL_DEPTH_TEST);
+    GlState::enable(GL_CULL_FACE);
+    GlState::disable(GL_BLEND);
+    GlState::depth_func(GL_LESS);
+    GlState::depth_mask(GL_TRUE);
+    GlState::color_mask(GL_FALSE);
+
+    // The items are sorted, so the opaque ones are drawn front to back
+    // within each group of state
+    if (!batches.empty()) {
+        for (const auto& batch : batches)
+            draw_batch(batch, *depth_prepass_program);
+    }
+    else {
+        for (const auto& item : items)
+            if (item.object && get_pass(item.key) == RenderPass::OPAQUE)
+                item.object->draw_depth(*depth_prepass_program);
+    }
+
+    GlState::color_mask(GL_TRUE);
+}
+
+void RenderQueue::build_batches()
+{
+    commands.clear();
+
+    for (size_t i = 0; i < items.size(); i++) {
+        const DrawItem& item = items[i];
+        if (!item.object || get_pass(item.key) != RenderPass::OPAQUE)
+            continue;
+
+        // Items are sorted by program and material, so the ones that can
+        // share a draw are next to each other
+        bool extends_batch = false;
+        if (!batches.empty()) {
+            const MultiDrawBatch& batch = batches.back();
+            const Object* last = items[batch.first_item + batch.num_items - 1].object;
+
+            extends_batch = batch.first_item + batch.num_items == i &&
+                            batch.instance_buffer_id == item.object->get_instance_buffer() &&
+                            &last->get_gpu_program() == &item.object->get_gpu_program() &&
+                            last->has_same_uniforms(*item.object);
+        }
+
+        if (!extends_batch)
+            batches.push_back({i, 0, commands.size(), 0, item.object->get_instance_buffer()});
+
+        size_t num_commands = commands.size();
+        item.object->append_draw_commands(commands);
+
+        batches.back().num_items++;
+        batches.back().num_commands += commands.size() - num_commands;
+    }
+
+    if (commands.empty()) {
+        batches.clear();
+        return;
+    }
+
+    command_allocation = StreamBuffer::write(commands.data(),
+                                             commands.size() * sizeof(DrawElementsIndirectCommand));
+}
+
+void RenderQueue::draw_batch(const MultiDrawBatch& batch, GpuProgram& program)
+{
+    program.use();
+    GlState::bind_vertex_array(GeometryPool::get_vao());
+
+    // Objects drawn one at a time through the pool point these attributes
+    // to their own buffers
+    ObjModel::set_instance_buffer(GeometryPool::get_vao(), batch.instance_buffer_id, 0);
+
+    GlState::bind_buffer(GL_DRAW_INDIRECT_BUFFER, command_allocation.buffer_id);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                (void*)(command_allocation.offset +
+                                        batch.first_command * sizeof(DrawElementsIndirectCommand)),
+                                batch.num_commands, 0);
+
+    Object::render_stats.draw_calls++;
+}
@@ -0,0 +1,438 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <format>
+
+#include <glm/common.hpp>
+
+#include "gl_extensions.hpp"
+#include "gl_state.hpp"
+#include "gpu_timer.hpp"
+#include "scene_target.hpp"
+
+// Weight of each new measurement in the average GPU time
+#define GPU_TIME_SMOOTHING 0.1f
+
+// Measurements taken at a scale before it may change again
+#define SCALE_UPDATE_SAMPLES 15
+
+// The scale only grows when the scene takes less than this fraction of the
+// target, so that it does not oscillate around it
+#define SCALE_GROW_THRESHOLD 0.85f
+
+#define SCALE_MAX_STEP_DOWN 0.15f
+#define SCALE_MAX_STEP_UP 0.05f
+
+const GLchar* const fxaa_vertex_shader_source = ""
+"#version 330 core\n"
+"out vec2 uv;\n"
+"void main()\n"
+"{\n"
+    // Triangle covering the whole screen, without vertex attributes
+    "vec2 ndc = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;\n"
+    "uv = ndc * 0.5 + 0.5;\n"
+    "gl_Position = vec4(ndc, 0.0, 1.0);\n"
+"}\n"
+"\0";
+
+// Single pass FXAA by Timothy Lottes, which finds the direction of the edge
+// from the luma of the four diagonal neighbours and blurs along it
+const GLchar* const fxaa_fragment_shader_source = ""
+"#version 330 core\n"
+"#define FXAA_REDUCE_MIN (1.0 / 128.0)\n"
+"#define FXAA_REDUCE_MUL (1.0 / 8.0)\n"
+"#define FXAA_SPAN_MAX 8.0\n"
+"uniform sampler2D scene;\n"
+"uniform vec2 texel_size;\n"
+"uniform vec2 uv_scale;\n"
+"in vec2 uv;\n"
+"out vec4 color;\n"
+// Texels outside the scaled scene hold stale images
+"vec3 fetch(vec2 p)\n"
+"{\n"
+    "return texture(scene, clamp(p, 0.5 * texel_size, uv_scale - 0.5 * texel_size)).rgb;\n"
+"}\n"
+"float luma(vec3 c)\n"
+"{\n"
+    "return dot(c, vec3(0.299, 0.587, 0.114));\n"
+"}\n"
+"void main()\n"
+"{\n"
+    "vec2 p = uv * uv_scale;\n"
+    "float luma_nw = luma(fetch(p + vec2(-1.0, -1.0) * texel_size));\n"
+    "float luma_ne = luma(fetch(p + vec2( 1.0, -1.0) * texel_size));\n"
+    "float luma_sw = luma(fetch(p + vec2(-1.0,  1.0) * texel_size));\n"
+    "float luma_se = luma(fetch(p + vec2( 1.0,  1.0) * texel_size));\n"
+    "vec3 rgb_m = fetch(p);\n"
+    "float luma_m = luma(rgb_m);\n"
+    "float luma_min = min(luma_m, min(min(luma_nw, luma_ne), min(luma_sw, luma_se)));\n"
+    "float luma_max = max(luma_m, max(max(luma_nw, luma_ne), max(luma_sw, luma_se)));\n"
+    "vec2 dir = vec2(-((luma_nw + luma_ne) - (luma_sw + luma_se)),\n"
+                    "((luma_nw + luma_sw) - (luma_ne + luma_se)));\n"
+    "float dir_reduce = max((luma_nw + luma_ne + luma_sw + luma_se) * 0.25 * FXAA_REDUCE_MUL, FXAA_REDUCE_MIN);\n"
+    "float rcp_dir_min = 1.0 / (min(abs(dir.x), abs(dir.y)) + dir_reduce);\n"
+    "dir = clamp(dir * rcp_dir_min, -FXAA_SPAN_MAX, FXAA_SPAN_MAX) * texel_size;\n"
+    "vec3 rgb_a = 0.5 * (fetch(p + dir * (1.0 / 3.0 - 0.5)) + fetch(p + dir * (2.0 / 3.0 - 0.5)));\n"
+    "vec3 rgb_b = rgb_a * 0.5 + 0.25 * (fetch(p - dir * 0.5) + fetch(p + dir * 0.5));\n"
+    "float luma_b = luma(rgb_b);\n"
+    "color.rgb = (luma_b < luma_min || luma_b > luma_max) ? rgb_a : rgb_b;\n"
+    "color.a = 1.0;\n"
+"}\n"
+"\0";
+
+const char* anti_aliasing_name(AntiAliasing mode)
+{
+    switch (mode) {
+        case AntiAliasing::MSAA_2X: return "MSAA 2x";
+        case AntiAliasing::MSAA_4X: return "MSAA 4x";
+        case AntiAliasing::MSAA_8X: return "MSAA 8x";
+        case AntiAliasing::FXAA:    return "FXAA";
+        default:                    return "Nenhum";
+    }
+}
+
+float SceneTarget::min_scale = 0.5f;
+float SceneTarget::max_scale = 1.0f;
+
+// Leaves room under 16.6 ms for the CPU side and the HUD
+float SceneTarget::target_gpu_time = 12.0f;
+
+AntiAliasing SceneTarget::anti_aliasing = AntiAliasing::MSAA_4X;
+
+SceneTarget::SceneTarget()
+{
+    glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+
+    if (min_scale > max_scale)
+        std::swap(min_scale, max_scale);
+
+    scale = max_scale;
+
+    glGenQueries(SCENE_TIMER_QUERIES, queries.data());
+
+    fxaa_program = std::make_unique<GpuProgram>(fxaa_vertex_shader_source, fxaa_fragment_shader_source);
+    fxaa_program->set_uniform("scene", FXAA_TEXTURE_UNIT);
+
+    glGenVertexArrays(1, &empty_vao_id);
+}
+
+SceneTarget::~SceneTarget()
+{
+    release();
+    glDeleteQueries(SCENE_TIMER_QUERIES, queries.data());
+    glDeleteVertexArrays(1, &empty_vao_id);
+}
+
+void SceneTarget::release()
+{
+    glDeleteFramebuffers(1, &scene_fbo_id);
+    glDeleteFramebuffers(1, &resolve_fbo_id);
+    glDeleteRenderbuffers(1, &color_rbo_id);
+    glDeleteRenderbuffers(1, &depth_rbo_id);
+    glDeleteRenderbuffers(1, &resolve_rbo_id);
+
+    // A new texture may get the same name, so the cached binding is dropped
+    if (color_texture_id != 0)
+        GlState::bind_texture(FXAA_TEXTURE_UNIT, GL_TEXTURE_2D, 0);
+    glDeleteTextures(1, &color_texture_id);
+
+    scene_fbo_id = resolve_fbo_id = 0;
+    color_rbo_id = depth_rbo_id = resolve_rbo_id = 0;
+    color_texture_id = 0;
+}
+
+void SceneTarget::allocate()
+{
+    release();
+
+    // Frames still in flight were drawn at the previous size or mode, and
+    // their times would move the scale of the new one
+    query_stale = query_pending;
+
+    allocated_size = glm::max(glm::ivec2(glm::vec2(window_size) * max_scale + 0.5f), glm::ivec2(1));
+    allocated_anti_aliasing = anti_aliasing;
+
+    switch (anti_aliasing) {
+        case AntiAliasing::MSAA_2X: samples = 2; break;
+        case AntiAliasing::MSAA_4X: samples = 4; break;
+        case AntiAliasing::MSAA_8X: samples = 8; break;
+        default:                    samples = 0; break;
+    }
+    samples = std::min<GLsizei>(samples, max_samples);
+
+    glGenFramebuffers(1, &scene_fbo_id);
+    glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo_id);
+
+    if (samples > 0) {
+        glGenRenderbuffers(1, &color_rbo_id);
+        glBindRenderbuffer(GL_RENDERBUFFER, color_rbo_id);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, allocated_size.x, allocated_size.y);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rbo_id);
+
+        // The driver may round the count up to one it supports
+        glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_SAMPLES, &samples);
+    }
+    else {
+        if (GlExtensions::direct_state_access) {
+            glCreateTextures(GL_TEXTURE_2D, 1, &color_texture_id);
+            glTextureStorage2D(color_texture_id, 1, GL_RGBA8, allocated_size.x, allocated_size.y);
+            glTextureParameteri(color_texture_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTextureParameteri(color_texture_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTextureParameteri(color_texture_id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTextureParameteri(color_texture_id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        else {
+            glGenTextures(1, &color_texture_id);
+            GlState::bind_texture(FXAA_TEXTURE_UNIT, GL_TEXTURE_2D, color_texture_id);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, allocated_size.x, allocated_size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture_id, 0);
+    }
+
+    glGenRenderbuffers(1, &depth_rbo_id);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_rbo_id);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, allocated_size.x, allocated_size.y);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rbo_id);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "ERROR: Scene framebuffer incomplete (%dx%d, %d samples)\n",
+                allocated_size.x, allocated_size.y, samples);
+
+    // Only multisampled images need to be resolved before scaling
+    if (samples == 0) {
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return;
+    }
+
+    glGenRenderbuffers(1, &resolve_rbo_id);
+    glBindRenderbuffer(GL_RENDERBUFFER, resolve_rbo_id);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, allocated_size.x, allocated_size.y);
+
+    glGenFramebuffers(1, &resolve_fbo_id);
+    glBindFramebuffer(GL_FRAMEBUFFER, resolve_fbo_id);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolve_rbo_id);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SceneTarget::begin(GLFWwindow* window)
+{
+    glm::ivec2 framebuffer_size;
+    glfwGetFramebufferSize(window, &framebuffer_size.x, &framebuffer_size.y);
+
+    // Minimized windows have no framebuffer
+    framebuffer_size = glm::max(framebuffer_size, glm::ivec2(1));
+
+    if (framebuffer_size != window_size || anti_aliasing != allocated_anti_aliasing) {
+        window_size = framebuffer_size;
+        allocate();
+    }
+
+    read_timer_queries();
+
+    if (!dynamic_scale)
+        scale = max_scale;
+
+    size = glm::clamp(glm::ivec2(glm::vec2(window_size) * scale + 0.5f), glm::ivec2(1), allocated_size);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo_id);
+    glViewport(0, 0, size.x, size.y);
+
+    // Frames are not timed while all queries are waiting for results
+    timing = !query_pending[next_query];
+    if (timing)
+        glBeginQuery(GL_TIME_ELAPSED, queries[next_query]);
+}
+
+void SceneTarget::end()
+{
+    GpuTimer::begin("resolve");
+
+    if (allocated_anti_aliasing == AntiAliasing::FXAA)
+        apply_fxaa();
+    else
+        resolve();
+
+    GpuTimer::end();
+
+    if (timing) {
+        glEndQuery(GL_TIME_ELAPSED);
+        query_pending[next_query] = true;
+        next_query = (next_query + 1) % SCENE_TIMER_QUERIES;
+    }
+
+    // The HUD is drawn over the scene at the window resolution
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, window_size.x, window_size.y);
+}
+
+void SceneTarget::resolve()
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, scene_fbo_id);
+
+    if (samples == 0 || size == window_size) {
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, window_size.x, window_size.y,
+                          GL_COLOR_BUFFER_BIT, size == window_size ? GL_NEAREST : GL_LINEAR);
+        return;
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_fbo_id);
+    glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, resolve_fbo_id);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, window_size.x, window_size.y,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+}
+
+void SceneTarget::apply_fxaa()
+{
+    // The pass also scales the scene to the window, through bilinear filtering
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, window_size.x, window_size.y);
+
+    GlState::disable(GL_DEPTH_TEST);
+    GlState::disable(GL_BLEND);
+    GlState::bind_texture(FXAA_TEXTURE_UNIT, GL_TEXTURE_2D, color_texture_id);
+
+    fxaa_program->use();
+    fxaa_program->set_uniform("texel_size", 1.0f / glm::vec2(allocated_size));
+    fxaa_program->set_uniform("uv_scale", glm::vec2(size) / glm::vec2(allocated_size));
+
+    GlState::bind_vertex_array(empty_vao_id);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    GlState::enable(GL_DEPTH_TEST);
+}
+
+void SceneTarget::read_timer_queries()
+{
+    // Queries finish in the order they were issued, starting from the oldest
+    for (int i = 0; i < SCENE_TIMER_QUERIES; i++) {
+        int query = (next_query + i) % SCENE_TIMER_QUERIES;
+        if (!query_pending[query])
+            continue;
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &nanoseconds);
+        query_pending[query] = false;
+
+        if (query_stale[query]) {
+            query_stale[query] = false;
+            continue;
+        }
+
+        measured_gpu_time += nanoseconds / 1e6;
+        measured_frames++;
+
+        update_scale(nanoseconds / 1e6f);
+    }
+}
+
+void SceneTarget::update_scale(float frame_gpu_time)
+{
+    if (gpu_time == 0.0f)
+        gpu_time = frame_gpu_time;
+    else
+        gpu_time += GPU_TIME_SMOOTHING * (frame_gpu_time - gpu_time);
+
+    if (++samples_since_change < SCALE_UPDATE_SAMPLES)
+        return;
+
+    bool too_slow = gpu_time > target_gpu_time;
+    bool has_headroom = gpu_time < SCALE_GROW_THRESHOLD * target_gpu_time;
+
+    if (!too_slow && !has_headroom)
+        return;
+
+    // The cost of the scene is mostly per pixel, so it follows the square
+    // of the scale
+    float new_scale = scale * std::sqrt(target_gpu_time / gpu_time);
+    new_scale = std::clamp(new_scale, scale - SCALE_MAX_STEP_DOWN, scale + SCALE_MAX_STEP_UP);
+    new_scale = std::clamp(new_scale, min_scale, max_scale);
+
+    if (new_scale == scale)
+        return;
+
+    // The average settles at the new scale before the next change
+    scale = new_scale;
+    samples_since_change = 0;
+}
+
+float SceneTarget::get_scale() const
+{
+    return scale;
+}
+
+glm::ivec2 SceneTarget::get_size() const
+{
+    return size;
+}
+
+glm::ivec2 SceneTarget::get_window_size() const
+{
+    return window_size;
+}
+
+float SceneTarget::get_gpu_time() const
+{
+    return gpu_time;
+}
+
+AntiAliasing SceneTarget::get_anti_aliasing() const
+{
+    return allocated_anti_aliasing;
+}
+
+GLsizei SceneTarget::get_samples() const
+{
+    return samples;
+}
+
+std::string SceneTarget::get_anti_aliasing_description() const
+{
+    bool multisampled = allocated_anti_aliasing != AntiAliasing::NONE &&
+                        allocated_anti_aliasing != AntiAliasing::FXAA;
+
+    // Modes above GL_MAX_SAMPLES are drawn with fewer samples, or none
+    if (multisampled && samples == 0)
+        return anti_aliasing_name(AntiAliasing::NONE);
+    if (multisampled)
+        return std::format("MSAA {}x", samples);
+
+    return anti_aliasing_name(allocated_anti_aliasing);
+}
+
+void SceneTarget::set_dynamic_scale(bool dynamic)
+{
+    dynamic_scale = dynamic;
+}
+
+void SceneTarget::reset_measurements()
+{
+    measured_gpu_time = 0.0;
+    measured_frames = 0;
+}
+
+double SceneTarget::get_measured_gpu_time() const
+{
+    return measured_gpu_time;
+}
+
+GLuint SceneTarget::get_measured_frames() const
+{
+    return measured_frames;
+}
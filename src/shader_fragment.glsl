@@ -18,23 +18,41 @@ in vec3 texcoords_skybox;
 
 in vec3 color_vert;
 
-// Matrizes computadas no código C++ e enviadas para a GPU
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-// Identificador que define qual objeto está sendo desenhado no momento
+// Dados compartilhados por todos os objetos desenhados em um quadro,
+// preenchidos uma vez por quadro no código C++ (veja "FrameUniforms" em gpu.hpp)
+layout (std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec4 light_position;
+    vec4 fog_color;
+};
+
+// Identificador que define qual objeto está sendo desenhado no momento.
+// Permutações do programa (veja GpuProgram::get_permutation) definem
+// OBJECT_ID e PIECE_COLOR, tornando os identificadores constantes e
+// permitindo ao compilador eliminar os desvios que dependem deles.
 #define BOARD 0
 #define PIECE 1
 #define TABLE 2
 #define SKY 3
 #define FLOOR 4
+#ifdef OBJECT_ID
+const int object_id = OBJECT_ID;
+#else
 uniform int object_id;
+#endif
 
 // Identificador que define qual a cor do objeto
 #define WHITE 0
 #define BLACK 1
+#ifdef PIECE_COLOR
+const int piece_color = PIECE_COLOR;
+#else
 uniform int piece_color;
+#endif
 
 #define NONE 0
 #define SELECTING 1
@@ -55,25 +73,43 @@ uniform vec2 lastmove_end_square;
 // Variáveis para acesso das imagens de textura
 uniform samplerCube SkyImage;
 
-uniform sampler2D FloorNormal;
-uniform sampler2D FloorImage;
-uniform sampler2D FloorAmbient;
-
-uniform sampler2D TableNormal;
-uniform sampler2D TableImage;
-uniform sampler2D TableAmbient;
-uniform sampler2D TableRoughness;
-
-uniform sampler2D BoardNormal;
-uniform sampler2D BoardImage;
-uniform sampler2D BoardAmbient;
-uniform sampler2D BoardRoughness;
-
-uniform sampler2D WhitePiecesImage;
-uniform sampler2D WhitePiecesAmbient;
-
-uniform sampler2D BlackPiecesImage;
-uniform sampler2D BlackPiecesAmbient;
+// As texturas de mesmo tamanho e formato são camadas de um mesmo array de
+// texturas. Cada sampler aponta para o array da sua textura, e a camada é
+// escolhida pelo uniform com o sufixo "Layer" (veja GpuProgram::finish_texture_upload).
+uniform sampler2DArray FloorNormal;
+uniform sampler2DArray FloorImage;
+uniform sampler2DArray FloorAmbient;
+uniform int FloorNormalLayer;
+uniform int FloorImageLayer;
+uniform int FloorAmbientLayer;
+
+uniform sampler2DArray TableNormal;
+uniform sampler2DArray TableImage;
+uniform sampler2DArray TableAmbient;
+uniform sampler2DArray TableRoughness;
+uniform int TableNormalLayer;
+uniform int TableImageLayer;
+uniform int TableAmbientLayer;
+uniform int TableRoughnessLayer;
+
+uniform sampler2DArray BoardNormal;
+uniform sampler2DArray BoardImage;
+uniform sampler2DArray BoardAmbient;
+uniform sampler2DArray BoardRoughness;
+uniform int BoardNormalLayer;
+uniform int BoardImageLayer;
+uniform int BoardAmbientLayer;
+uniform int BoardRoughnessLayer;
+
+uniform sampler2DArray WhitePiecesImage;
+uniform sampler2DArray WhitePiecesAmbient;
+uniform int WhitePiecesImageLayer;
+uniform int WhitePiecesAmbientLayer;
+
+uniform sampler2DArray BlackPiecesImage;
+uniform sampler2DArray BlackPiecesAmbient;
+uniform int BlackPiecesImageLayer;
+uniform int BlackPiecesAmbientLayer;
 
 // O valor de saída ("out") de um Fragment Shader é a cor final do fragmento.
 out vec4 color;
@@ -81,6 +117,12 @@ out vec4 color;
 #define SQUARE_SIZE 0.05789
 #define BOARD_START (-4 * SQUARE_SIZE)
 
+// Amostra uma camada de um array de texturas
+vec4 texture_layer(sampler2DArray image, int layer, vec2 uv)
+{
+    return texture(image, vec3(uv, layer));
+}
+
 // FONTE: https://iquilezles.org/articles/functions/
 float gain(float x, float k)
 {
@@ -92,10 +134,9 @@ float gain(float x, float k)
 // Inspired by: https://iquilezles.org/articles/fog/
 vec3 apply_fog(vec3 color, float distance)
 {
-    vec3  fog_color  = texture(SkyImage, vec3(0.5, -0.01, 0.5)).rgb;
     float fog_amount = 1.0 - exp(-distance * 0.015);
     fog_amount = gain(fog_amount, 1.5);
-    return mix(color, fog_color, fog_amount);
+    return mix(color, fog_color.rgb, fog_amount);
 }
 
 vec3 lambert_diffuse_term(vec3 diffuse_light_color,
@@ -145,6 +186,12 @@ ivec2 get_current_square()
 
 void main()
 {
+#ifdef DEPTH_ONLY
+    // Somente a profundidade é escrita, no pré-passe de profundidade
+    color = vec4(0.0);
+    return;
+#endif
+
     // O fragmento atual é coberto por um ponto que percente à superfície de um
     // dos objetos virtuais da cena. Este ponto, p, possui uma posição no
     // sistema de coordenadas global (World coordinates). Esta posição é obtida
@@ -154,15 +201,8 @@ void main()
 
     vec4 norm = normal;
 
-    // Obtemos a posição da câmera utilizando a inversa da matriz que define o
-    // sistema de coordenadas da câmera.
-    vec4 origin = vec4(0.0, 0.0, 0.0, 1.0);
-    vec4 camera_position = inverse(view) * origin;
-
-    vec4 light_pos = vec4(70.0,100.0,71.0,1.0);
-
     // Vetor que define o sentido da fonte de luz em relação ao ponto atual.
-    vec4 light_vec = normalize(light_pos - p);
+    vec4 light_vec = normalize(light_position - p);
 
     // Espectro da fonte de luz
     vec3 diffuse_light_color = vec3(1.0,1.0,1.0);
@@ -193,44 +233,50 @@ void main()
 
     switch (object_id) {
         case SKY:
-            color.rgb = texture(SkyImage, texcoords_skybox).rgb;
-            color.rgb = apply_fog(color.rgb, 10 * length((camera_position - p).xz));
+            // Ponto do cubo unitário centrado na câmera na direção do
+            // fragmento, seja ele desenhado pelo cubo ou pelo triângulo
+            vec3 sky_point = 0.5 * texcoords_skybox / max(max(abs(texcoords_skybox.x),
+                                                              abs(texcoords_skybox.y)),
+                                                          abs(texcoords_skybox.z));
+
+            color.rgb = texture(SkyImage, sky_point).rgb;
+            color.rgb = apply_fog(color.rgb, 10 * length(sky_point.xz));
             color.rgb = pow(color.rgb, vec3(1.0)/3.5);
             return;
 
         case FLOOR:
-            norm = texture(FloorNormal, 50 * texcoords) * 2.0 - 0.5;
+            norm = texture_layer(FloorNormal, FloorNormalLayer, 50 * texcoords) * 2.0 - 0.5;
             norm = vec4(normalize(tbn * norm.xyz), 0.0);
 
-            surface_color = texture(FloorImage, 50 * texcoords).rgb;
-            ambient_refl_color = surface_color * texture(FloorAmbient, 50 * texcoords).r;
+            surface_color = texture_layer(FloorImage, FloorImageLayer, 50 * texcoords).rgb;
+            ambient_refl_color = surface_color * texture_layer(FloorAmbient, FloorAmbientLayer, 50 * texcoords).r;
             specular_refl_color = vec3(0.0);
             break;
 
         case TABLE:
-            norm = texture(TableNormal, texcoords) * 2.0 - 0.5;
+            norm = texture_layer(TableNormal, TableNormalLayer, texcoords) * 2.0 - 0.5;
             norm = vec4(normalize(tbn * norm.xyz), 0.0);
 
-            surface_color = texture(TableImage, texcoords).rgb;
-            ambient_refl_color = surface_color * texture(TableAmbient, texcoords).r;
+            surface_color = texture_layer(TableImage, TableImageLayer, texcoords).rgb;
+            ambient_refl_color = surface_color * texture_layer(TableAmbient, TableAmbientLayer, texcoords).r;
 
             refl_vec = reflect(view_vec, norm);
             specular_light_color = texture(SkyImage, glossy_reflection(refl_vec)).rgb;
-            specular_refl_color = vec3(max(0.0, (1 - 2.2 * gain(texture(TableRoughness, texcoords).r, 0.5))));
+            specular_refl_color = vec3(max(0.0, (1 - 2.2 * gain(texture_layer(TableRoughness, TableRoughnessLayer, texcoords).r, 0.5))));
 
             q = 15.0;
             break;
 
         case BOARD:
-            norm = texture(BoardNormal, texcoords) * 2.0 - 0.5;
+            norm = texture_layer(BoardNormal, BoardNormalLayer, texcoords) * 2.0 - 0.5;
             norm = vec4(normalize(tbn * norm.xyz), 0.0);
 
-            surface_color = texture(BoardImage, texcoords).rgb;
-            ambient_refl_color = surface_color * texture(BoardAmbient, texcoords).r;
+            surface_color = texture_layer(BoardImage, BoardImageLayer, texcoords).rgb;
+            ambient_refl_color = surface_color * texture_layer(BoardAmbient, BoardAmbientLayer, texcoords).r;
 
             refl_vec = reflect(view_vec, norm);
             specular_light_color = texture(SkyImage, refl_vec.xyz).rgb;
-            specular_refl_color = vec3(0.05 * (1 - texture(BoardRoughness, texcoords).r));
+            specular_refl_color = vec3(0.05 * (1 - texture_layer(BoardRoughness, BoardRoughnessLayer, texcoords).r));
 
             q = 60.0;
 
@@ -249,16 +295,16 @@ void main()
         case PIECE:
             switch (piece_color) {
                 case WHITE:
-                    surface_color = texture(WhitePiecesImage, texcoords).rgb;
-                    ambient_refl_color = surface_color * texture(WhitePiecesAmbient, texcoords).r;
+                    surface_color = texture_layer(WhitePiecesImage, WhitePiecesImageLayer, texcoords).rgb;
+                    ambient_refl_color = surface_color * texture_layer(WhitePiecesAmbient, WhitePiecesAmbientLayer, texcoords).r;
                     specular_refl_color = vec3(0.0);
                     break;
 
                 case BLACK:
                     norm = normalize(normal);
 
-                    surface_color = texture(BlackPiecesImage, texcoords).rgb;
-                    ambient_refl_color = surface_color * texture(BlackPiecesAmbient, texcoords).r;
+                    surface_color = texture_layer(BlackPiecesImage, BlackPiecesImageLayer, texcoords).rgb;
+                    ambient_refl_color = surface_color * texture_layer(BlackPiecesAmbient, BlackPiecesAmbientLayer, texcoords).r;
 
                     refl_vec = reflect(view_vec, norm);
                     specular_light_color = texture(SkyImage, refl_vec.xyz).rgb;
@@ -271,8 +317,9 @@ void main()
 
     vec3 diffuse_term;
 
-    // If vertex shader generated a color, use Gouraud Shading for diffuse illumination
-    if (color_vert != vec3(0.0)) {
+    // White pieces use Gouraud Shading for diffuse illumination, with the
+    // color generated by the vertex shader
+    if (object_id == PIECE && piece_color == WHITE) {
         diffuse_term = surface_color * color_vert;
     }
     else {
@@ -6,23 +6,46 @@ layout (location = 1) in vec4 normal_coefficients;
 layout (location = 2) in vec2 texture_coefficients;
 layout (location = 3) in vec4 tangent_coefficients;
 
-// Matrizes computadas no código C++ e enviadas para a GPU
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-// Identificador que define qual objeto está sendo desenhado no momento
+// Matrizes de cada instância, computadas no código C++
+// A matriz de normais é a inversa da transposta da matriz de modelagem
+layout (location = 4) in mat4 model;
+layout (location = 8) in mat3 normal_matrix;
+
+// Dados compartilhados por todos os objetos desenhados em um quadro,
+// preenchidos uma vez por quadro no código C++ (veja "FrameUniforms" em gpu.hpp)
+layout (std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec4 light_position;
+    vec4 fog_color;
+};
+
+// Identificador que define qual objeto está sendo desenhado no momento.
+// Permutações do programa (veja GpuProgram::get_permutation) definem
+// OBJECT_ID e PIECE_COLOR, tornando os identificadores constantes e
+// permitindo ao compilador eliminar os desvios que dependem deles.
 #define BOARD 0
 #define PIECE 1
 #define TABLE 2
 #define SKY 3
 #define FLOOR 4
+#ifdef OBJECT_ID
+const int object_id = OBJECT_ID;
+#else
 uniform int object_id;
+#endif
 
 // Identificador que define qual a cor do objeto
 #define WHITE 0
 #define BLACK 1
+#ifdef PIECE_COLOR
+const int piece_color = PIECE_COLOR;
+#else
 uniform int piece_color;
+#endif
 
 // Atributos de vértice que serão gerados como saída ("out") pelo Vertex Shader.
 // ** Estes serão interpolados pelo rasterizador! ** gerando, assim, valores
@@ -36,6 +59,10 @@ out vec2 texcoords;
 out vec3 texcoords_skybox;
 out vec3 color_vert;
 
+// A posição é calculada da mesma forma em todas as permutações, de modo que
+// a profundidade escrita pelo pré-passe de profundidade seja idêntica
+invariant gl_Position;
+
 #define SQUARE_SIZE (0.05789 * 1.5f)
 #define BOARD_START (-4 * SQUARE_SIZE)
 
@@ -48,6 +75,18 @@ vec3 lambert_diffuse_gouraud(vec3 diffuse_light_color,
 
 void main()
 {
+#ifdef SKY_FULLSCREEN
+    // O céu é um triângulo que cobre a tela inteira, no plano de fundo
+    // (z = w), desenhado somente onde nenhum outro objeto foi desenhado
+    vec2 ndc = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    gl_Position = vec4(ndc, 1.0, 1.0);
+
+    // Direção do raio da câmera que passa pelo vértice, em coordenadas globais
+    vec3 view_ray = vec3(ndc.x / projection[0][0], ndc.y / projection[1][1], -1.0);
+    texcoords_skybox = transpose(mat3(view)) * view_ray;
+    return;
+#endif
+
     // A variável gl_Position define a posição final de cada vértice
     // OBRIGATORIAMENTE em "normalized device coordinates" (NDC), onde cada
     // coeficiente estará entre -1 e 1 após divisão por w.
@@ -60,7 +99,11 @@ void main()
     // deste Vertex Shader, a placa de vídeo (GPU) fará a divisão por W. Veja
     // slides 41-67 e 69-86 do documento Aula_09_Projecoes.pdf.
 
-    gl_Position = projection * view * model * model_coefficients;
+    gl_Position = view_projection * model * model_coefficients;
+
+#ifdef DEPTH_ONLY
+    return;
+#endif
 
     // Agora definimos outros atributos dos vértices que serão interpolados pelo
     // rasterizador para gerar atributos únicos para cada fragmento gerado.
@@ -73,8 +116,7 @@ void main()
 
     // Normal do vértice atual no sistema de coordenadas global (World).
     // Veja slides 123-151 do documento Aula_07_Transformacoes_Geometricas_3D.pdf.
-    normal = inverse(transpose(model)) * normal_coefficients;
-    normal.w = 0.0;
+    normal = vec4(normal_matrix * normal_coefficients.xyz, 0.0);
 
     // Coordenadas de textura obtidas do arquivo OBJ (se existirem!)
     texcoords = texture_coefficients;
@@ -89,16 +131,12 @@ void main()
 
     tbn = mat3(t, b, n);
 
-    vec4 origin = vec4(0.0, 0.0, 0.0, 1.0);
-    vec4 camera_position = inverse(view) * origin;
     texcoords_skybox = (position_world - camera_position).xyz;
 
     vec3 diffuse_light_color = vec3(1.0,1.0,1.0);
 
-    vec4 light_pos = vec4(70.0,100.0,71.0,1.0);
-
     // Vetor que define o sentido da fonte de luz em relação ao ponto atual.
-    vec4 light_vec = normalize(light_pos - position_world);
+    vec4 light_vec = normalize(light_position - position_world);
 
     color_vert = vec3(0.0);
 
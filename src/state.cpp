@@ -52,6 +52,7 @@ void GameStateManager::push_state(std::unique_ptr<GameState> state)
     state->set_gpu_program(gpu_program);
     states.push_back(std::move(state));
     states.back()->load();
+    request_redraw();
 }
 
 void GameStateManager::pop_state()
@@ -59,6 +60,7 @@ void GameStateManager::pop_state()
     if (!empty()) {
         states.back()->unload();
         states.pop_back();
+        request_redraw();
     }
 }
 
@@ -77,3 +79,15 @@ bool GameStateManager::empty()
 {
     return states.empty();
 }
+
+void GameStateManager::request_redraw()
+{
+    redraw_requested = true;
+}
+
+bool GameStateManager::consume_redraw_request()
+{
+    bool requested = redraw_requested;
+    redraw_requested = false;
+    return requested;
+}
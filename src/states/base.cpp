@@ -17,6 +17,10 @@ void BaseState::load()
         std::set<int> {}
     );
 
+    // Os shaders são recarregados em segundo plano sempre que seus arquivos
+    // são salvos, ou quando a tecla R é pressionada
+    gpu_program->watch_shader_files();
+
     manager->push_state(std::make_unique<MenuState>());
 }
 
@@ -30,6 +34,10 @@ void BaseState::update(float delta_t)
     if (input->get_is_key_pressed(GLFW_KEY_R))
         gpu_program->reload_shaders();
 
+    // The frame that picks up the new shaders is drawn as well
+    if (gpu_program->update_reload() || input->has_activity())
+        manager->request_redraw();
+
     input->update();
 }
 
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <memory>
 #include <set>
 #include <string_view>
@@ -11,10 +14,22 @@
 #include "input.hpp"
 #include "object.hpp"
 #include "gpu.hpp"
+#include "gl_state.hpp"
+#include "gpu_timer.hpp"
+#include "program_cache.hpp"
 #include "collisions.hpp"
 #include "animation.hpp"
 #include "textrendering.hpp"
 
+// Duração de cada passagem do benchmark de culling, em segundos
+#define CULLING_BENCHMARK_DURATION 12.0f
+
+// Duração de cada modo do benchmark de antisserrilhamento, em segundos. As
+// medidas começam após a troca de modo, quando não há mais quadros do modo
+// anterior em andamento na GPU.
+#define ANTI_ALIASING_BENCHMARK_DURATION 6.0f
+#define ANTI_ALIASING_BENCHMARK_WARMUP 0.5f
+
 void GameplayState::load()
 {
     lookat_camera = std::make_shared<LookAtCamera>();
@@ -64,6 +79,9 @@ void GameplayState::load()
             GLFW_KEY_RIGHT,
             GLFW_KEY_ENTER,
             GLFW_KEY_O,
+            GLFW_KEY_B,
+            GLFW_KEY_P,
+            GLFW_KEY_N,
         },
         std::vector<int> {
             GLFW_MOUSE_BUTTON_LEFT
@@ -76,6 +94,12 @@ void GameplayState::load()
 
     hud = std::make_unique<Hud>(window->glfw_window, &camera);
 
+    // A cena é desenhada fora da tela, em uma resolução ajustada ao tempo de GPU
+    scene_target = std::make_unique<SceneTarget>();
+    hud->set_scene_target(scene_target.get());
+
+    frame_uniforms = std::make_unique<UniformBuffer>(FRAME_UNIFORMS_BINDING);
+
     sky_model    = std::make_shared<ObjModel>("../../data/models/cube.obj");
     floor_model  = std::make_shared<ObjModel>("../../data/models/plane.obj");
     table_model  = std::make_shared<ObjModel>("../../data/models/table.obj");
@@ -88,55 +112,53 @@ void GameplayState::load()
     queen_model  = std::make_shared<ObjModel>("../../data/models/queen.obj");
     bishop_model = std::make_shared<ObjModel>("../../data/models/bishop.obj");
 
-    sky    = std::make_shared<Object>(sky_model,    *gpu_program);
-    floor  = std::make_shared<Object>(floor_model,  *gpu_program);
-    table  = std::make_shared<Object>(table_model,  *gpu_program);
-    board  = std::make_shared<Object>(board_model,  *gpu_program);
+    // Cada tipo de objeto é desenhado por uma permutação do programa de GPU,
+    // compilada com o identificador do objeto e a cor da peça como constantes
+    GpuProgram& sky_program   = gpu_program->get_permutation({"OBJECT_ID SKY"});
+    GpuProgram& floor_program = gpu_program->get_permutation({"OBJECT_ID FLOOR"});
+    GpuProgram& table_program = gpu_program->get_permutation({"OBJECT_ID TABLE"});
+    GpuProgram& board_program = gpu_program->get_permutation({"OBJECT_ID BOARD"});
+    GpuProgram& white_program = gpu_program->get_permutation({"OBJECT_ID PIECE", "PIECE_COLOR WHITE"});
+    GpuProgram& black_program = gpu_program->get_permutation({"OBJECT_ID PIECE", "PIECE_COLOR BLACK"});
+
+    // Programas do céu desenhado depois da geometria opaca e da pré-passada de profundidade
+    sky_fullscreen_program = &gpu_program->get_permutation({"OBJECT_ID SKY", "SKY_FULLSCREEN"});
+    depth_program          = &gpu_program->get_permutation({"DEPTH_ONLY"});
+
+    // Nomes das etapas no tempo de GPU mostrado pelo HUD, as peças das duas
+    // cores são somadas
+    sky_program.timer_scope             = "sky";
+    sky_fullscreen_program->timer_scope = "sky";
+    floor_program.timer_scope           = "floor";
+    table_program.timer_scope           = "table";
+    board_program.timer_scope           = "board";
+    white_program.timer_scope           = "pieces";
+    black_program.timer_scope           = "pieces";
+
+    ProgramCache::print_stats();
+
+    sky    = std::make_shared<Object>(sky_model,    sky_program);
+    floor  = std::make_shared<Object>(floor_model,  floor_program);
+    table  = std::make_shared<Object>(table_model,  table_program);
+    board  = std::make_shared<Object>(board_model,  board_program);
 
     // Os Objects compartilham uniforms, podendo ter múltiplas instâncias 
     // criadas através de múltiplas matrizes de transformação
-    white_pawn   = std::make_shared<Object>(pawn_model,   *gpu_program);
-    white_king   = std::make_shared<Object>(king_model,   *gpu_program);
-    white_rook   = std::make_shared<Object>(rook_model,   *gpu_program);
-    white_knight = std::make_shared<Object>(knight_model, *gpu_program);
-    white_queen  = std::make_shared<Object>(queen_model,  *gpu_program);
-    white_bishop = std::make_shared<Object>(bishop_model, *gpu_program);
-    black_pawn   = std::make_shared<Object>(pawn_model,   *gpu_program);
-    black_king   = std::make_shared<Object>(king_model,   *gpu_program);
-    black_rook   = std::make_shared<Object>(rook_model,   *gpu_program);
-    black_knight = std::make_shared<Object>(knight_model, *gpu_program);
-    black_queen  = std::make_shared<Object>(queen_model,  *gpu_program);
-    black_bishop = std::make_shared<Object>(bishop_model, *gpu_program);
-
-    sky->set_uniform("object_id", SKY);
-    floor->set_uniform("object_id", FLOOR);
-    table->set_uniform("object_id", TABLE);
-    board->set_uniform("object_id", BOARD);
-
-    white_pawn->set_uniform("object_id", PIECE);
-    white_pawn->set_uniform("piece_color", PIECE_WHITE);
-    white_king->set_uniform("object_id", PIECE);
-    white_king->set_uniform("piece_color", PIECE_WHITE);
-    white_rook->set_uniform("object_id", PIECE);
-    white_rook->set_uniform("piece_color", PIECE_WHITE);
-    white_knight->set_uniform("object_id", PIECE);
-    white_knight->set_uniform("piece_color", PIECE_WHITE);
-    white_queen->set_uniform("object_id", PIECE);
-    white_queen->set_uniform("piece_color", PIECE_WHITE);
-    white_bishop->set_uniform("object_id", PIECE);
-    white_bishop->set_uniform("piece_color", PIECE_WHITE);
-    black_pawn->set_uniform("object_id", PIECE);
-    black_pawn->set_uniform("piece_color", PIECE_BLACK);
-    black_king->set_uniform("object_id", PIECE);
-    black_king->set_uniform("piece_color", PIECE_BLACK);
-    black_rook->set_uniform("object_id", PIECE);
-    black_rook->set_uniform("piece_color", PIECE_BLACK);
-    black_knight->set_uniform("object_id", PIECE);
-    black_knight->set_uniform("piece_color", PIECE_BLACK);
-    black_queen->set_uniform("object_id", PIECE);
-    black_queen->set_uniform("piece_color", PIECE_BLACK);
-    black_bishop->set_uniform("object_id", PIECE);
-    black_bishop->set_uniform("piece_color", PIECE_BLACK);
+    white_pawn   = std::make_shared<Object>(pawn_model,   white_program);
+    white_king   = std::make_shared<Object>(king_model,   white_program);
+    white_rook   = std::make_shared<Object>(rook_model,   white_program);
+    white_knight = std::make_shared<Object>(knight_model, white_program);
+    white_queen  = std::make_shared<Object>(queen_model,  white_program);
+    white_bishop = std::make_shared<Object>(bishop_model, white_program);
+    black_pawn   = std::make_shared<Object>(pawn_model,   black_program);
+    black_king   = std::make_shared<Object>(king_model,   black_program);
+    black_rook   = std::make_shared<Object>(rook_model,   black_program);
+    black_knight = std::make_shared<Object>(knight_model, black_program);
+    black_queen  = std::make_shared<Object>(queen_model,  black_program);
+    black_bishop = std::make_shared<Object>(bishop_model, black_program);
+
+    // No modo RenderMode::SKY_FIRST o céu é desenhado antes de tudo, sem teste de profundidade
+    sky->set_render_pass(RenderPass::BACKGROUND);
 
     // Definimos as posições dos objetos
     floor->set_transform(0, Matrix_Scale(100.0f, 1.0f, 100.0f));
@@ -198,16 +220,14 @@ void GameplayState::load()
     update_shader_selected_square();
 
     // Enable Z-buffer
-    glEnable(GL_DEPTH_TEST);
+    GlState::enable(GL_DEPTH_TEST);
 
     // Enable backface culling
-    glEnable(GL_CULL_FACE);
+    GlState::enable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
 
-    // Enable transparent objects
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // Transparency is enabled only for the blended pass of the render queue
 }
 
 void GameplayState::unload() {}
@@ -316,6 +336,32 @@ void GameplayState::process_inputs(float delta_t)
     if (input->get_is_key_pressed(GLFW_KEY_F3))
         hud->toggle_debug_info();
 
+    // Percorre um caminho fixo de câmera medindo o efeito do frustum culling
+    if (input->get_is_key_pressed(GLFW_KEY_B) && !culling_benchmark.running && !anti_aliasing_benchmark.running)
+        start_culling_benchmark();
+
+    // Percorre o mesmo caminho com cada modo de antisserrilhamento
+    if (input->get_is_key_pressed(GLFW_KEY_N) && !culling_benchmark.running && !anti_aliasing_benchmark.running)
+        start_anti_aliasing_benchmark();
+
+    // Alterna entre os modos de desenho do céu e da geometria opaca
+    if (input->get_is_key_pressed(GLFW_KEY_P)) {
+        switch (render_mode) {
+            case RenderMode::SKY_FIRST:
+                render_mode = RenderMode::SKY_LAST;
+                printf("Modo de desenho: céu por último\n");
+                break;
+            case RenderMode::SKY_LAST:
+                render_mode = RenderMode::DEPTH_PREPASS;
+                printf("Modo de desenho: pré-passada de profundidade\n");
+                break;
+            case RenderMode::DEPTH_PREPASS:
+                render_mode = RenderMode::SKY_FIRST;
+                printf("Modo de desenho: céu primeiro\n");
+                break;
+        }
+    }
+
     // Alterna entre estado de manipulação da câmera e estado de 
     // seleção de casa através da tecla ESC
     if (input->get_is_key_pressed(GLFW_KEY_ESCAPE) ||
@@ -414,6 +460,9 @@ void GameplayState::process_inputs(float delta_t)
                                                 observer_input->get_gamepad_axis_value(GLFW_JOYSTICK_1,
                                                                                    GLFW_GAMEPAD_AXIS_RIGHT_TRIGGER)));
 
+    if (observer_input->has_activity() || input->has_activity())
+        manager->request_redraw();
+
     observer_input->update();
     input->update();
 
@@ -421,10 +470,9 @@ void GameplayState::process_inputs(float delta_t)
                                         camera->get_position().y - 0.5,
                                         camera->get_position().z - 0.5));
 
-    gpu_program->set_uniform("view", camera->get_view_matrix());
-    gpu_program->set_uniform("projection", camera->get_projection_matrix());
-
-    hud->update(input->get_cursor_position(), col);
+    // O HUD também muda sem entrada, com as informações de depuração
+    if (hud->update(input->get_cursor_position(), col))
+        manager->request_redraw();
 }
 
 std::pair<std::shared_ptr<Object>, int> GameplayState::piece_to_object_instance(chess::Square sq, chess::Piece piece) {
@@ -585,8 +633,160 @@ void GameplayState::update_chess_game(float delta_t) {
     }
 }
 
+void GameplayState::start_culling_benchmark()
+{
+    culling_benchmark = CullingBenchmark();
+    culling_benchmark.running = true;
+    culling_benchmark.previous_camera = camera;
+    culling_benchmark.previous_free_camera = free_camera;
+
+    free_camera = build_free_camera(camera);
+    camera = free_camera;
+    window->set_user_pointer(camera.get());
+
+    // A primeira passagem é feita sem culling
+    Object::frustum_culling = false;
+
+    printf("Benchmark de culling iniciado\n");
+}
+
+void GameplayState::update_culling_benchmark(float delta_t)
+{
+    CullingBenchmark& b = culling_benchmark;
+
+    // Estatísticas do quadro anterior, desenhado com a configuração da passagem atual
+    if (b.time > 0.0f) {
+        b.frames[b.pass]++;
+        b.draw_calls[b.pass] += Object::render_stats_last_frame.draw_calls;
+        b.instances[b.pass] += Object::render_stats_last_frame.instances_drawn;
+        b.seconds[b.pass] += delta_t;
+    }
+
+    b.time += delta_t;
+
+    if (b.time > CULLING_BENCHMARK_DURATION) {
+        if (b.pass == 0) {
+            b.pass = 1;
+            b.time = 0.0f;
+            Object::frustum_culling = true;
+        }
+        else {
+            for (int pass = 0; pass < 2; pass++) {
+                unsigned long frames = std::max(b.frames[pass], 1ul);
+                printf("%s culling: %.1f chamadas de desenho/quadro, %.1f instâncias/quadro, %.2f ms/quadro\n",
+                       pass == 0 ? "Sem" : "Com",
+                       float(b.draw_calls[pass]) / frames,
+                       float(b.instances[pass]) / frames,
+                       1000.0f * b.seconds[pass] / frames);
+            }
+
+            camera = b.previous_camera;
+            free_camera = b.previous_free_camera;
+            window->set_user_pointer(camera.get());
+            b.running = false;
+            return;
+        }
+    }
+
+    move_benchmark_camera(b.time / CULLING_BENCHMARK_DURATION);
+}
+
+void GameplayState::start_anti_aliasing_benchmark()
+{
+    anti_aliasing_benchmark = AntiAliasingBenchmark();
+    anti_aliasing_benchmark.running = true;
+    anti_aliasing_benchmark.previous_camera = camera;
+    anti_aliasing_benchmark.previous_free_camera = free_camera;
+    anti_aliasing_benchmark.previous_mode = SceneTarget::anti_aliasing;
+
+    free_camera = build_free_camera(camera);
+    camera = free_camera;
+    window->set_user_pointer(camera.get());
+
+    // Todos os modos são medidos na mesma resolução
+    scene_target->set_dynamic_scale(false);
+    SceneTarget::anti_aliasing = AntiAliasing(0);
+
+    printf("Benchmark de antisserrilhamento iniciado\n");
+}
+
+void GameplayState::update_anti_aliasing_benchmark(float delta_t)
+{
+    AntiAliasingBenchmark& b = anti_aliasing_benchmark;
+
+    // Tempo do quadro anterior, desenhado com o modo atual
+    if (b.time > ANTI_ALIASING_BENCHMARK_WARMUP) {
+        b.frames[b.mode]++;
+        b.seconds[b.mode] += delta_t;
+    }
+
+    float previous_time = b.time;
+    b.time += delta_t;
+
+    if (previous_time <= ANTI_ALIASING_BENCHMARK_WARMUP && b.time > ANTI_ALIASING_BENCHMARK_WARMUP)
+        scene_target->reset_measurements();
+
+    if (b.time > ANTI_ALIASING_BENCHMARK_DURATION) {
+        b.gpu_milliseconds[b.mode] = scene_target->get_measured_gpu_time();
+        b.gpu_frames[b.mode] = scene_target->get_measured_frames();
+        b.descriptions[b.mode] = scene_target->get_anti_aliasing_description();
+
+        if (b.mode + 1 < int(AntiAliasing::COUNT)) {
+            b.mode++;
+            b.time = 0.0f;
+            SceneTarget::anti_aliasing = AntiAliasing(b.mode);
+        }
+        else {
+            for (int mode = 0; mode < int(AntiAliasing::COUNT); mode++) {
+                unsigned long frames = std::max(b.frames[mode], 1ul);
+                unsigned long gpu_frames = std::max(b.gpu_frames[mode], 1ul);
+                printf("%s: %.2f ms/quadro, %.2f ms de GPU na cena/quadro\n",
+                       b.descriptions[mode].c_str(),
+                       1000.0f * b.seconds[mode] / frames,
+                       b.gpu_milliseconds[mode] / gpu_frames);
+            }
+
+            SceneTarget::anti_aliasing = b.previous_mode;
+            scene_target->set_dynamic_scale(true);
+
+            camera = b.previous_camera;
+            free_camera = b.previous_free_camera;
+            window->set_user_pointer(camera.get());
+            b.running = false;
+            return;
+        }
+    }
+
+    move_benchmark_camera(b.time / ANTI_ALIASING_BENCHMARK_DURATION);
+}
+
+void GameplayState::move_benchmark_camera(float fraction)
+{
+    // Volta ao redor da mesa, olhando ora para o tabuleiro, ora para fora dele
+    float angle = 2.0f * M_PI * fraction;
+
+    camera->set_position(2.5f * sin(angle), 1.3f, 2.5f * cos(angle));
+    camera->set_angles(angle + M_PI + 1.5f * sin(3.0f * angle), 0.35f);
+}
+
 void GameplayState::update(float delta_t)
 {
+    // Benchmarks and animations change the scene on every frame, including
+    // the one in which they end
+    if (culling_benchmark.running || anti_aliasing_benchmark.running ||
+        chess_game->current_state == ChessGame::IngameState::ONGOING_MOVE)
+        manager->request_redraw();
+
+    if (culling_benchmark.running)
+        update_culling_benchmark(delta_t);
+
+    if (anti_aliasing_benchmark.running)
+        update_anti_aliasing_benchmark(delta_t);
+
+    // High resolution textures, streamed in after the game started
+    if (!gpu_program->upload_pending_textures())
+        manager->request_redraw();
+
     // PASSO 1: atualizações sob demanda
     process_inputs(delta_t);
 
@@ -597,23 +797,56 @@ void GameplayState::update(float delta_t)
 
 void GameplayState::draw()
 {
+    // Dados compartilhados por todos os objetos desenhados no quadro. São
+    // escritos aqui, e não em update(), pois quadros sem mudanças na cena não
+    // são desenhados no modo sob demanda.
+    FrameUniforms frame;
+    frame.view = camera->get_view_matrix();
+    frame.projection = camera->get_projection_matrix();
+    frame.view_projection = frame.projection * frame.view;
+    frame.camera_position = camera->get_position();
+    frame.light_position = glm::vec4(70.0f, 100.0f, 71.0f, 1.0f);
+    frame.fog_color = gpu_program->fog_color;
+    frame_uniforms->update(&frame, sizeof(frame));
+
+    scene_target->begin(window->glfw_window);
+
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_CULL_FACE);
-    sky->draw();
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    // Coleta os objetos da cena e os desenha ordenados por estado
+    glm::vec4 camera_position = camera->get_position();
+
+    ViewInfo view;
+    view.frustum = Frustum(camera->get_projection_matrix() * camera->get_view_matrix());
+    view.camera_position = camera_position;
+    view.projection_scale = camera->get_projection_scale();
+    view.perspective = camera->is_projection_perspective();
+
+    render_queue.clear();
+
+    // O céu pode ser desenhado por último, apenas nos pixels em que a
+    // profundidade não foi escrita por nenhum objeto
+    if (render_mode == RenderMode::SKY_FIRST)
+        sky->collect(render_queue, view);
+    else
+        render_queue.push_fullscreen(RenderPass::BACKDROP, *sky_fullscreen_program);
 
-    floor->draw();
+    render_queue.set_depth_prepass(render_mode == RenderMode::DEPTH_PREPASS ? depth_program : nullptr);
 
-    table->draw();
+    floor->collect(render_queue, view);
+    table->collect(render_queue, view);
+    render_queue.submit();
 
+    // A cena é ampliada para o tamanho da janela, e o HUD desenhado por cima
+    // na resolução nativa
+    scene_target->end();
+
+    GpuTimer::begin("text");
     hud->draw();
 
-    // Mensagem de fim de jogo
-    if(chess_game->is_game_over()) {
+    // Mensagem de fim de jogo, montada uma única vez
+    if(chess_game->is_game_over() && !end_message) {
         std::string end_msg;
         switch (chess_game->winner) {
             case chess::Color(chess::Color::WHITE):
@@ -626,6 +859,13 @@ void GameplayState::draw()
                 end_msg = "EMPATE!";
                 break;
         }
-        TextRendering_PrintString(window->glfw_window, end_msg, HUD_START, HUD_TOP - TextRendering_LineHeight(window->glfw_window) * 4.0f, 4.0f);
+        end_message = std::make_unique<Label>(glm::vec2(0.0f), end_msg, 4.0f);
+    }
+
+    if (end_message) {
+        end_message->set_position(glm::vec2(HUD_START, HUD_TOP - TextRendering_LineHeight(window->glfw_window) * 4.0f));
+        end_message->draw();
     }
+
+    GpuTimer::end();
 }
@@ -1,5 +1,7 @@
 #include <memory>
 #include <format>
+#include <string_view>
+#include <vector>
 
 #include "states/loading.hpp"
 #include "states/game.hpp"
@@ -11,6 +13,52 @@ LoadingState::LoadingState(TEXTURE_QUALITY q)
     texture_quality = q;
 }
 
+// Textures loaded before the game starts
+static const std::vector<std::pair<std::string_view, std::string_view>> low_textures = {
+    {"../../data/textures/floor/diffuse_low.jpg", "FloorImage"},
+    {"../../data/textures/floor/ambient_low.jpg", "FloorAmbient"},
+    {"../../data/textures/floor/normal_low.jpg", "FloorNormal"},
+
+    {"../../data/textures/table/diffuse_low.jpg", "TableImage"},
+    {"../../data/textures/table/ambient_low.jpg", "TableAmbient"},
+    {"../../data/textures/table/roughness_low.jpg", "TableRoughness"},
+    {"../../data/textures/table/normal_low.jpg", "TableNormal"},
+
+    {"../../data/textures/board/diffuse_low.jpg", "BoardImage"},
+    {"../../data/textures/board/ambient_low.jpg", "BoardAmbient"},
+    {"../../data/textures/board/roughness_low.jpg", "BoardRoughness"},
+    {"../../data/textures/board/normal_low.jpg", "BoardNormal"},
+
+    {"../../data/textures/black_pieces/diffuse_low.jpg", "BlackPiecesImage"},
+    {"../../data/textures/black_pieces/ambient_low.jpg", "BlackPiecesAmbient"},
+
+    {"../../data/textures/white_pieces/diffuse_low.jpg", "WhitePiecesImage"},
+    {"../../data/textures/white_pieces/ambient_low.jpg", "WhitePiecesAmbient"},
+};
+
+// Streamed in while playing, replacing the low resolution textures
+static const std::vector<std::pair<std::string_view, std::string_view>> high_textures = {
+    {"../../data/textures/floor/diffuse_high.jpg", "FloorImage"},
+    {"../../data/textures/floor/ambient_high.jpg", "FloorAmbient"},
+    {"../../data/textures/floor/normal_high.jpg", "FloorNormal"},
+
+    {"../../data/textures/table/diffuse_high.jpg", "TableImage"},
+    {"../../data/textures/table/ambient_high.jpg", "TableAmbient"},
+    {"../../data/textures/table/roughness_high.jpg", "TableRoughness"},
+    {"../../data/textures/table/normal_high.jpg", "TableNormal"},
+
+    {"../../data/textures/board/diffuse_high.jpg", "BoardImage"},
+    {"../../data/textures/board/ambient_high.jpg", "BoardAmbient"},
+    {"../../data/textures/board/roughness_high.jpg", "BoardRoughness"},
+    {"../../data/textures/board/normal_high.jpg", "BoardNormal"},
+
+    {"../../data/textures/black_pieces/diffuse_high.jpg", "BlackPiecesImage"},
+    {"../../data/textures/black_pieces/ambient_high.jpg", "BlackPiecesAmbient"},
+
+    {"../../data/textures/white_pieces/diffuse_high.jpg", "WhitePiecesImage"},
+    {"../../data/textures/white_pieces/ambient_high.jpg", "WhitePiecesAmbient"},
+};
+
 void LoadingState::load()
 {
     if (texture_quality == HIGH) {
@@ -21,28 +69,6 @@ void LoadingState::load()
                                                   "../../data/textures/sky/pz_high.hdr",
                                                   "../../data/textures/sky/nz_high.hdr"},
                                                   "SkyImage");
-
-        gpu_program->load_textures_async({
-            {"../../data/textures/floor/diffuse_high.jpg", "FloorImage"},
-            {"../../data/textures/floor/ambient_high.jpg", "FloorAmbient"},
-            {"../../data/textures/floor/normal_high.jpg", "FloorNormal"},
-
-            {"../../data/textures/table/diffuse_high.jpg", "TableImage"},
-            {"../../data/textures/table/ambient_high.jpg", "TableAmbient"},
-            {"../../data/textures/table/roughness_high.jpg", "TableRoughness"},
-            {"../../data/textures/table/normal_high.jpg", "TableNormal"},
-
-            {"../../data/textures/board/diffuse_high.jpg", "BoardImage"},
-            {"../../data/textures/board/ambient_high.jpg", "BoardAmbient"},
-            {"../../data/textures/board/roughness_high.jpg", "BoardRoughness"},
-            {"../../data/textures/board/normal_high.jpg", "BoardNormal"},
-
-            {"../../data/textures/black_pieces/diffuse_high.jpg", "BlackPiecesImage"},
-            {"../../data/textures/black_pieces/ambient_high.jpg", "BlackPiecesAmbient"},
-
-            {"../../data/textures/white_pieces/diffuse_high.jpg", "WhitePiecesImage"},
-            {"../../data/textures/white_pieces/ambient_high.jpg", "WhitePiecesAmbient"},
-        });
     }
     else {
         gpu_program->load_cubemap_from_hdr_files({"../../data/textures/sky/px_low.hdr",
@@ -52,29 +78,11 @@ void LoadingState::load()
                                                   "../../data/textures/sky/pz_low.hdr",
                                                   "../../data/textures/sky/nz_low.hdr"},
                                                   "SkyImage");
-
-        gpu_program->load_textures_async({
-            {"../../data/textures/floor/diffuse_low.jpg", "FloorImage"},
-            {"../../data/textures/floor/ambient_low.jpg", "FloorAmbient"},
-            {"../../data/textures/floor/normal_low.jpg", "FloorNormal"},
-
-            {"../../data/textures/table/diffuse_low.jpg", "TableImage"},
-            {"../../data/textures/table/ambient_low.jpg", "TableAmbient"},
-            {"../../data/textures/table/roughness_low.jpg", "TableRoughness"},
-            {"../../data/textures/table/normal_low.jpg", "TableNormal"},
-
-            {"../../data/textures/board/diffuse_low.jpg", "BoardImage"},
-            {"../../data/textures/board/ambient_low.jpg", "BoardAmbient"},
-            {"../../data/textures/board/roughness_low.jpg", "BoardRoughness"},
-            {"../../data/textures/board/normal_low.jpg", "BoardNormal"},
-
-            {"../../data/textures/black_pieces/diffuse_low.jpg", "BlackPiecesImage"},
-            {"../../data/textures/black_pieces/ambient_low.jpg", "BlackPiecesAmbient"},
-
-            {"../../data/textures/white_pieces/diffuse_low.jpg", "WhitePiecesImage"},
-            {"../../data/textures/white_pieces/ambient_low.jpg", "WhitePiecesAmbient"},
-        });
     }
+
+    // The game starts with the low resolution set, the high one is streamed
+    // in afterwards
+    gpu_program->load_textures_async(low_textures);
 }
 
 void LoadingState::unload() {}
@@ -82,10 +90,17 @@ void LoadingState::unload() {}
 void LoadingState::update(float dt)
 {
     if (!loading_complete) {
+        // The progress is drawn on every frame until the game starts
+        manager->request_redraw();
+
         loading_complete = gpu_program->upload_pending_textures();
 
-        if (loading_complete)
+        if (loading_complete) {
+            if (texture_quality == HIGH)
+                gpu_program->stream_textures_async(high_textures);
+
             manager->change_state(std::make_unique<GameplayState>());
+        }
     }
 }
 
@@ -97,9 +112,15 @@ void LoadingState::draw()
     float lineheight = TextRendering_LineHeight(window->glfw_window);
     float charwidth = TextRendering_CharWidth(window->glfw_window);
 
-    float loading_progress = float(gpu_program->num_uploaded_textures) * 100.0f / float(gpu_program->num_loaded_textures);
+    if (!progress_label)
+        progress_label = std::make_unique<Label>();
+
+    float loading_progress = gpu_program->get_upload_progress() * 100.0f;
+    if (shown_progress != loading_progress) {
+        progress_label->set_text(std::format("Carregando... {:.2f}%", loading_progress));
+        shown_progress = loading_progress;
+    }
 
-    TextRendering_PrintString(window->glfw_window,
-                              std::format("Carregando... {:.2f}%", loading_progress),
-                              -10 * charwidth, -0.5 * lineheight);
+    progress_label->set_position(glm::vec2(-10 * charwidth, -0.5 * lineheight));
+    progress_label->draw();
 }
@@ -8,6 +8,7 @@
 #include "hud.hpp"
 
 #include "input.hpp"
+#include "scene_target.hpp"
 #include "textrendering.hpp"
 
 void MenuState::load()
@@ -39,6 +40,25 @@ void MenuState::load()
                                                       "Alta",
                                                       2.0f);
 
+    title_label = std::make_unique<Label>(glm::vec2(HUD_START + BORDER_MARGIN * 2.0F, 1.0f - BORDER_MARGIN * 10.0f),
+                                          "FChessG", 4.0f);
+
+    texture_quality_label = std::make_unique<Label>(glm::vec2(HUD_START + BORDER_MARGIN * 2.0F, HUD_BOTTOM + BORDER_MARGIN * 10.0f),
+                                                    "Qualidade de texturas:", 2.0f);
+
+    // O antisserrilhamento fica acima da qualidade de texturas
+    float lineheight = TextRendering_LineHeight(window->glfw_window);
+    glm::vec2 anti_aliasing_pos(HUD_START + BORDER_MARGIN * 2.0F, HUD_BOTTOM + BORDER_MARGIN * 9.0f + 5.0f * lineheight);
+
+    anti_aliasing_button = std::make_unique<Button>(window->glfw_window,
+                                                    input.get(),
+                                                    anti_aliasing_pos,
+                                                    anti_aliasing_name(SceneTarget::anti_aliasing),
+                                                    2.0f);
+
+    anti_aliasing_label = std::make_unique<Label>(glm::vec2(HUD_START + BORDER_MARGIN * 2.0F, HUD_BOTTOM + BORDER_MARGIN * 10.0f + 5.0f * lineheight),
+                                                  "Antisserrilhamento:", 2.0f);
+
     texture_quality = HIGH;
 }
 
@@ -46,6 +66,10 @@ void MenuState::unload() {}
 
 void MenuState::update(float delta_t)
 {
+    // The buttons grow while the cursor is over them
+    if (input->has_activity())
+        manager->request_redraw();
+
     if (play_button->is_clicked()) {
         manager->change_state(std::make_unique<LoadingState>(texture_quality));
     }
@@ -60,6 +84,18 @@ void MenuState::update(float delta_t)
         else
             texture_quality_button->set_scale(2.0f);
 
+        if (anti_aliasing_button->is_selecting())
+            anti_aliasing_button->set_scale(2.5f);
+        else
+            anti_aliasing_button->set_scale(2.0f);
+
+        // Percorre os modos de antisserrilhamento, aplicados ao desenhar a cena
+        if (anti_aliasing_button->is_clicked()) {
+            int mode = (int(SceneTarget::anti_aliasing) + 1) % int(AntiAliasing::COUNT);
+            SceneTarget::anti_aliasing = AntiAliasing(mode);
+            anti_aliasing_button->set_text(anti_aliasing_name(SceneTarget::anti_aliasing));
+        }
+
         if (texture_quality_button->is_clicked()) {
             if (texture_quality == HIGH) {
                 texture_quality = LOW;
@@ -80,10 +116,11 @@ void MenuState::draw()
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    TextRendering_PrintString(window->glfw_window, "FChessG", HUD_START + BORDER_MARGIN * 2.0F, 1.0f - BORDER_MARGIN * 10.0f, 4.0f);
-
-    TextRendering_PrintString(window->glfw_window, "Qualidade de texturas:", HUD_START + BORDER_MARGIN * 2.0F, HUD_BOTTOM + BORDER_MARGIN * 10.0f, 2.0f);
+    title_label->draw();
+    texture_quality_label->draw();
+    anti_aliasing_label->draw();
 
     play_button->draw();
     texture_quality_button->draw();
+    anti_aliasing_button->draw();
 }
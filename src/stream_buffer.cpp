@@ -0,0 +1,148 @@
+#include <cstring>
+
+#include <glad/gl.h>
+
+#include "stream_buffer.hpp"
+#include "gl_extensions.hpp"
+#include "gl_state.hpp"
+
+GLsizeiptr StreamBuffer::bytes_written_last_frame = 0;
+GLuint StreamBuffer::stalls = 0;
+
+GLuint StreamBuffer::buffer_id = 0;
+char* StreamBuffer::mapped_data = nullptr;
+bool StreamBuffer::persistent = false;
+
+GLsizeiptr StreamBuffer::frame_size = STREAM_INITIAL_FRAME_SIZE;
+GLsizeiptr StreamBuffer::frame_offset = 0;
+size_t StreamBuffer::frame = 0;
+
+std::array<GLsync, STREAM_FRAMES_IN_FLIGHT> StreamBuffer::fences = {};
+std::vector<StreamBuffer::RetiredBuffer> StreamBuffer::retired_buffers;
+
+void StreamBuffer::create()
+{
+    GLsizeiptr size = frame_size * STREAM_FRAMES_IN_FLIGHT;
+    persistent = GlExtensions::buffer_storage;
+
+    // The copy target is not used for drawing, so binding it here does not
+    // disturb any other state
+    glGenBuffers(1, &buffer_id);
+    GlState::bind_buffer(GL_COPY_WRITE_BUFFER, buffer_id);
+
+    if (persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+        mapped_data = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+    }
+    else {
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+}
+
+void StreamBuffer::grow(GLsizeiptr required_size)
+{
+    // Draws already issued in this frame still read from the old buffer
+    if (buffer_id != 0)
+        retired_buffers.push_back({buffer_id, STREAM_FRAMES_IN_FLIGHT});
+
+    for (GLsync& fence : fences) {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+
+    while (frame_size < required_size)
+        frame_size *= 2;
+
+    frame_offset = 0;
+    create();
+}
+
+void StreamBuffer::wait_for_region()
+{
+    GLsync& fence = fences[frame % STREAM_FRAMES_IN_FLIGHT];
+    if (!fence)
+        return;
+
+    // Usually signaled long ago, the region was used frames in flight ago
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        stalls++;
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    }
+
+    glDeleteSync(fence);
+    fence = 0;
+}
+
+StreamAllocation StreamBuffer::write(const void* data, GLsizeiptr size, GLsizeiptr alignment)
+{
+    if (buffer_id == 0)
+        create();
+
+    // The alignment of instance data is its size, not always a power of two
+    GLsizeiptr region_start = (frame % STREAM_FRAMES_IN_FLIGHT) * frame_size;
+    GLsizeiptr offset = (region_start + frame_offset + alignment - 1) / alignment * alignment;
+
+    if (offset + size > region_start + frame_size) {
+        grow(frame_offset + size + alignment);
+
+        region_start = (frame % STREAM_FRAMES_IN_FLIGHT) * frame_size;
+        offset = (region_start + alignment - 1) / alignment * alignment;
+    }
+
+    if (persistent) {
+        std::memcpy(mapped_data + offset, data, size);
+    }
+    else {
+        // The region is not read by any pending draw, so the driver does
+        // not need to synchronize the mapping
+        GlState::bind_buffer(GL_COPY_WRITE_BUFFER, buffer_id);
+        void* mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                        GL_MAP_INVALIDATE_RANGE_BIT);
+        if (mapped) {
+            std::memcpy(mapped, data, size);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+    }
+
+    frame_offset = offset + size - region_start;
+    return {buffer_id, offset};
+}
+
+void StreamBuffer::end_frame()
+{
+    bytes_written_last_frame = frame_offset;
+
+    for (auto it = retired_buffers.begin(); it != retired_buffers.end(); ) {
+        if (--it->frames_left == 0) {
+            GlState::forget_buffer(it->buffer_id);
+            glDeleteBuffers(1, &it->buffer_id);
+            it = retired_buffers.erase(it);
+        }
+        else {
+            it++;
+        }
+    }
+
+    if (buffer_id == 0)
+        return;
+
+    if (persistent)
+        fences[frame % STREAM_FRAMES_IN_FLIGHT] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    frame++;
+    frame_offset = 0;
+
+    if (persistent) {
+        wait_for_region();
+    }
+    else if (frame % STREAM_FRAMES_IN_FLIGHT == 0) {
+        // Draws of the previous frames keep the old storage alive
+        GlState::bind_buffer(GL_COPY_WRITE_BUFFER, buffer_id);
+        glBufferData(GL_COPY_WRITE_BUFFER, frame_size * STREAM_FRAMES_IN_FLIGHT, NULL, GL_STREAM_DRAW);
+    }
+}
@@ -1,6 +1,9 @@
 // Based on http://hamelot.io/visualization/opengl-text-without-any-external-libraries/
 //   and on https://github.com/rougier/freetype-gl
+#include <algorithm>
+#include <array>
 #include <string>
+#include <vector>
 
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
@@ -12,6 +15,10 @@
 #include "dejavufont.h"
 
 #include "gpu.hpp"
+#include "gl_extensions.hpp"
+#include "gl_state.hpp"
+#include "stream_buffer.hpp"
+#include "textrendering.hpp"
 
 const GLchar* const textvertexshader_source = ""
 "#version 330\n"
@@ -36,17 +43,47 @@ const GLchar* const textfragmentshader_source = ""
 "\0";
 
 GLuint textVAO;
-GLuint textVBO;
 GLuint textprogram_id;
 GLuint texttexture_id;
 
-void TextRendering_Init()
+// Glyphs indexed by codepoint, built once in TextRendering_Init()
+std::array<texture_glyph_t*, 256> textglyphs = {};
+
+// Quads of every string printed in the current frame, drawn at once by
+// TextRendering_Flush()
+struct TextVertex {
+    float x, y, s, t;
+};
+std::vector<TextVertex> textvertices;
+
+// Retained geometries to be drawn by TextRendering_Flush()
+std::vector<const TextGeometry*> textgeometries;
+
+// Window size, updated only when the window is resized
+int textwindow_width = 1;
+int textwindow_height = 1;
+unsigned int textwindow_size_version = 0;
+
+void TextRendering_UpdateWindowSize(GLFWwindow* window)
+{
+    glfwGetWindowSize(window, &textwindow_width, &textwindow_height);
+
+    // A minimized window has size zero
+    textwindow_width = std::max(textwindow_width, 1);
+    textwindow_height = std::max(textwindow_height, 1);
+
+    textwindow_size_version++;
+}
+
+unsigned int TextRendering_WindowSizeVersion()
+{
+    return textwindow_size_version;
+}
+
+void TextRendering_Init(GLFWwindow* window)
 {
     GLuint sampler;
 
-    glGenBuffers(1, &textVBO);
-    glGenVertexArrays(1, &textVAO);
-    glGenTextures(1, &texttexture_id);
     glGenSamplers(1, &sampler);
     glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -57,63 +94,66 @@ void TextRendering_Init()
     GpuProgram gpu_program = GpuProgram(textvertexshader_source, textfragmentshader_source);
 
     textprogram_id = gpu_program.id;
-    glLinkProgram(textprogram_id);
-    glCheckError();
-
-    GLuint texttex_uniform;
-    texttex_uniform = glGetUniformLocation(textprogram_id, "tex");
     glCheckError();
 
+    // The vertices of the VAO are read from the stream buffer, set up when
+    // drawn
     GLuint textureunit = 31;
-    glActiveTexture(GL_TEXTURE0 + textureunit);
-    glBindTexture(GL_TEXTURE_2D, texttexture_id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, dejavufont.tex_width, dejavufont.tex_height, 0, GL_RED, GL_UNSIGNED_BYTE, dejavufont.tex_data);
-    glBindSampler(textureunit, sampler);
+    if (GlExtensions::direct_state_access) {
+        glCreateTextures(GL_TEXTURE_2D, 1, &texttexture_id);
+        glTextureStorage2D(texttexture_id, 1, GL_R8, dejavufont.tex_width, dejavufont.tex_height);
+        glTextureSubImage2D(texttexture_id, 0, 0, 0, dejavufont.tex_width, dejavufont.tex_height, GL_RED, GL_UNSIGNED_BYTE, dejavufont.tex_data);
+        GlState::bind_texture(textureunit, GL_TEXTURE_2D, texttexture_id);
+
+        glCreateVertexArrays(1, &textVAO);
+        glVertexArrayAttribFormat(textVAO, 0, 4, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(textVAO, 0, 0);
+        glEnableVertexArrayAttrib(textVAO, 0);
+    }
+    else {
+        glGenTextures(1, &texttexture_id);
+        GlState::bind_texture(textureunit, GL_TEXTURE_2D, texttexture_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, dejavufont.tex_width, dejavufont.tex_height, 0, GL_RED, GL_UNSIGNED_BYTE, dejavufont.tex_data);
+
+        glGenVertexArrays(1, &textVAO);
+        GlState::bind_vertex_array(textVAO);
+        glEnableVertexAttribArray(0);
+    }
+    GlState::bind_sampler(textureunit, sampler);
     glCheckError();
 
-    glBindVertexArray(textVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferData(GL_ARRAY_BUFFER, 24 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
+    gpu_program.set_uniform("tex", (int)textureunit);
     glCheckError();
 
-    glUseProgram(textprogram_id);
-    glUniform1i(texttex_uniform, textureunit);
-    glUseProgram(0);
-    glCheckError();
+    for (size_t i = 0; i < dejavufont.glyphs_count; i++)
+    {
+        uint32_t codepoint = dejavufont.glyphs[i].codepoint;
+        if (codepoint < textglyphs.size() && !textglyphs[codepoint])
+            textglyphs[codepoint] = &dejavufont.glyphs[i];
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glCheckError();
+    TextRendering_UpdateWindowSize(window);
 }
 
 float textscale = 1.5f;
 
-void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f)
+// Lays out the glyph quads of a string, in normalized device coordinates
+static void TextRendering_LayoutString(const std::string &str, float x, float y, float scale,
+                                       std::vector<TextVertex> &vertices)
 {
     scale *= textscale;
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    float sx = scale / width;
-    float sy = scale / height;
+    float sx = scale / textwindow_width;
+    float sy = scale / textwindow_height;
 
     for (size_t i = 0; i < str.size(); i++)
     {
         // Find the glyph for the character we are looking for
-        texture_glyph_t *glyph = 0;
-        for (size_t j = 0; j < dejavufont.glyphs_count; ++j)
-        {
-            if (dejavufont.glyphs[j].codepoint == (uint32_t)str[i])
-            {
-                glyph = &dejavufont.glyphs[j];
-                break;
-            }
-        }
-        if (!glyph) {
+        uint32_t codepoint = (uint32_t)str[i];
+        if (codepoint >= textglyphs.size() || !textglyphs[codepoint]) {
             continue;
         }
+        texture_glyph_t *glyph = textglyphs[codepoint];
+
         x += glyph->kerning[0].kerning;
         float x0 = (float) (x + glyph->offset_x * sx);
         float y0 = (float) (y + glyph->offset_y * sy);
@@ -125,54 +165,142 @@ void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float
         float s1 = glyph->s1 - 0.5f/dejavufont.tex_width;
         float t1 = glyph->t1 - 0.5f/dejavufont.tex_height;
 
-        struct {float x, y, s, t;} data[6] = {
+        vertices.insert(vertices.end(), {
             { x0, y0, s0, t0 },
             { x0, y1, s0, t1 },
             { x1, y1, s1, t1 },
             { x0, y0, s0, t0 },
             { x1, y1, s1, t1 },
             { x1, y0, s1, t0 }
-        };
+        });
+
+        x += (glyph->advance_x * sx);
+    }
+}
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale)
+{
+    TextRendering_LayoutString(str, x, y, scale, textvertices);
+}
 
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glDepthFunc(GL_ALWAYS);
-        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, 24 * sizeof(float), data);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+void TextRendering_BuildGeometry(TextGeometry &geometry, const std::string &str, float x, float y, float scale)
+{
+    static std::vector<TextVertex> vertices;
+    vertices.clear();
+    TextRendering_LayoutString(str, x, y, scale, vertices);
+
+    GLsizeiptr size = vertices.size() * sizeof(TextVertex);
+    if (size > geometry.capacity)
+        geometry.capacity = size;
+
+    // The buffer keeps mutable storage, since the text and its size change,
+    // and labels such as the FPS counter are rebuilt every few frames.
+    // Orphaning avoids waiting for draws of the previous geometry.
+    if (GlExtensions::direct_state_access) {
+        if (geometry.vao == 0) {
+            glCreateVertexArrays(1, &geometry.vao);
+            glCreateBuffers(1, &geometry.vbo);
+
+            glVertexArrayVertexBuffer(geometry.vao, 0, geometry.vbo, 0, sizeof(TextVertex));
+            glVertexArrayAttribFormat(geometry.vao, 0, 4, GL_FLOAT, GL_FALSE, 0);
+            glVertexArrayAttribBinding(geometry.vao, 0, 0);
+            glEnableVertexArrayAttrib(geometry.vao, 0);
+        }
 
-        glUseProgram(textprogram_id);
-        glBindVertexArray(textVAO);
+        glNamedBufferData(geometry.vbo, geometry.capacity, NULL, GL_DYNAMIC_DRAW);
+        glNamedBufferSubData(geometry.vbo, 0, size, vertices.data());
+    }
+    else {
+        if (geometry.vao == 0) {
+            glGenVertexArrays(1, &geometry.vao);
+            glGenBuffers(1, &geometry.vbo);
+
+            GlState::bind_vertex_array(geometry.vao);
+            GlState::bind_buffer(GL_ARRAY_BUFFER, geometry.vbo);
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+            glEnableVertexAttribArray(0);
+        }
+        else {
+            GlState::bind_buffer(GL_ARRAY_BUFFER, geometry.vbo);
+        }
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBufferData(GL_ARRAY_BUFFER, geometry.capacity, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices.data());
+    }
 
-        glBindVertexArray(0);
-        glUseProgram(0);
-        glDepthFunc(GL_LESS);
+    geometry.num_vertices = vertices.size();
+}
 
-        glDisable(GL_BLEND);
+void TextRendering_DrawGeometry(const TextGeometry &geometry)
+{
+    if (geometry.num_vertices > 0)
+        textgeometries.push_back(&geometry);
+}
 
-        x += (glyph->advance_x * sx);
+void TextRendering_DeleteGeometry(TextGeometry &geometry)
+{
+    // Geometries queued for this frame are no longer valid
+    std::erase(textgeometries, &geometry);
+
+    // Labels created later may get the same names
+    GlState::forget_buffer(geometry.vbo);
+    GlState::forget_vertex_array(geometry.vao);
+    glDeleteBuffers(1, &geometry.vbo);
+    glDeleteVertexArrays(1, &geometry.vao);
+    geometry = TextGeometry();
+}
+
+void TextRendering_Flush()
+{
+    if (textvertices.empty() && textgeometries.empty())
+        return;
+
+    GlState::enable(GL_BLEND);
+    GlState::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    GlState::polygon_mode(GL_FILL);
+    GlState::depth_func(GL_ALWAYS);
+
+    GpuProgram::use_program(textprogram_id);
+
+    for (const TextGeometry *geometry : textgeometries) {
+        GlState::bind_vertex_array(geometry->vao);
+        glDrawArrays(GL_TRIANGLES, 0, geometry->num_vertices);
     }
+
+    if (!textvertices.empty()) {
+        StreamAllocation allocation = StreamBuffer::write(textvertices.data(),
+                                                          textvertices.size() * sizeof(TextVertex));
+
+        GlState::bind_vertex_array(textVAO);
+        if (GlExtensions::direct_state_access) {
+            glVertexArrayVertexBuffer(textVAO, 0, allocation.buffer_id, allocation.offset, sizeof(TextVertex));
+        }
+        else {
+            GlState::bind_buffer(GL_ARRAY_BUFFER, allocation.buffer_id);
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void*)allocation.offset);
+        }
+
+        glDrawArrays(GL_TRIANGLES, 0, textvertices.size());
+    }
+
+    GlState::depth_func(GL_LESS);
+    GlState::disable(GL_BLEND);
+
+    textvertices.clear();
+    textgeometries.clear();
 }
 
 float TextRendering_LineHeight(GLFWwindow* window)
 {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    return dejavufont.height / height * textscale;
+    return dejavufont.height / textwindow_height * textscale;
 }
 
 float TextRendering_CharWidth(GLFWwindow* window)
 {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    return dejavufont.glyphs[32].advance_x / width * textscale;
+    return dejavufont.glyphs[32].advance_x / textwindow_width * textscale;
 }
 
-void TextRendering_PrintMatrix(GLFWwindow* window, glm::mat4 M, float x, float y, float scale = 1.0f)
+void TextRendering_PrintMatrix(GLFWwindow* window, glm::mat4 M, float x, float y, float scale)
 {
     char buffer[40];
     float lineheight = TextRendering_LineHeight(window) * scale;
@@ -187,7 +315,7 @@ void TextRendering_PrintMatrix(GLFWwindow* window, glm::mat4 M, float x, float y
     TextRendering_PrintString(window, buffer, x, y - 3*lineheight, scale);
 }
 
-void TextRendering_PrintVector(GLFWwindow* window, glm::vec4 v, float x, float y, float scale = 1.0f)
+void TextRendering_PrintVector(GLFWwindow* window, glm::vec4 v, float x, float y, float scale)
 {
     char buffer[10];
     float lineheight = TextRendering_LineHeight(window) * scale;
@@ -202,7 +330,7 @@ void TextRendering_PrintVector(GLFWwindow* window, glm::vec4 v, float x, float y
     TextRendering_PrintString(window, buffer, x, y - 3*lineheight, scale);
 }
 
-void TextRendering_PrintMatrixVectorProduct(GLFWwindow* window, glm::mat4 M, glm::vec4 v, float x, float y, float scale = 1.0f)
+void TextRendering_PrintMatrixVectorProduct(GLFWwindow* window, glm::mat4 M, glm::vec4 v, float x, float y, float scale)
 {
     char buffer[70];
     float lineheight = TextRendering_LineHeight(window) * scale;
@@ -218,7 +346,7 @@ void TextRendering_PrintMatrixVectorProduct(GLFWwindow* window, glm::mat4 M, glm
     TextRendering_PrintString(window, buffer, x, y - 3*lineheight, scale);
 }
 
-void TextRendering_PrintMatrixVectorProductMoreDigits(GLFWwindow* window, glm::mat4 M, glm::vec4 v, float x, float y, float scale = 1.0f)
+void TextRendering_PrintMatrixVectorProductMoreDigits(GLFWwindow* window, glm::mat4 M, glm::vec4 v, float x, float y, float scale)
 {
     char buffer[70];
     float lineheight = TextRendering_LineHeight(window) * scale;
@@ -234,7 +362,7 @@ void TextRendering_PrintMatrixVectorProductMoreDigits(GLFWwindow* window, glm::m
     TextRendering_PrintString(window, buffer, x, y - 3*lineheight, scale);
 }
 
-void TextRendering_PrintMatrixVectorProductDivW(GLFWwindow* window, glm::mat4 M, glm::vec4 v, float x, float y, float scale = 1.0f)
+void TextRendering_PrintMatrixVectorProductDivW(GLFWwindow* window, glm::mat4 M, glm::vec4 v, float x, float y, float scale)
 {
     auto r = M*v;
     auto w = r[3];
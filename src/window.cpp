@@ -7,6 +7,13 @@
 #define OPENGL_VERSION_MAJOR 3
 #define OPENGL_VERSION_MINOR 3
 
+// Version asked for first, with direct state access
+#define OPENGL_DSA_VERSION_MAJOR 4
+#define OPENGL_DSA_VERSION_MINOR 5
+
+bool Window::request_direct_state_access = true;
+bool Window::damaged = true;
+
 // Callback for printing GLFW errors
 void glfw_error_callback(int error, const char* description)
 {
@@ -15,18 +22,38 @@ void glfw_error_callback(int error, const char* description)
 
 Window::Window(const char* title, int width, int height)
 {
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, OPENGL_VERSION_MAJOR);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, OPENGL_VERSION_MINOR);
-
     #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     #endif
 
     // Use OpenGL core profile, for solely modern functions
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_SAMPLES, 4);
 
-    glfw_window = glfwCreateWindow(width, height, title, NULL, NULL);
+    // The scene is multisampled in its own offscreen target, the window only
+    // receives the resolved image and the HUD
+    glfwWindowHint(GLFW_SAMPLES, 0);
+
+    // Drivers without OpenGL 4.5 fail to create the window, which is then
+    // created again with the 3.3 context the game requires. The expected
+    // error is not printed.
+    glfw_window = NULL;
+    if (request_direct_state_access)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, OPENGL_DSA_VERSION_MAJOR);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, OPENGL_DSA_VERSION_MINOR);
+
+        GLFWerrorfun error_callback = glfwSetErrorCallback(NULL);
+        glfw_window = glfwCreateWindow(width, height, title, NULL, NULL);
+        glfwSetErrorCallback(error_callback);
+    }
+
+    if (!glfw_window)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, OPENGL_VERSION_MAJOR);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, OPENGL_VERSION_MINOR);
+        glfw_window = glfwCreateWindow(width, height, title, NULL, NULL);
+    }
+
     if (!glfw_window)
     {
         glfwTerminate();
@@ -35,6 +62,10 @@ Window::Window(const char* title, int width, int height)
 
     glfwSetWindowUserPointer(glfw_window, this);
 
+    // The user pointer is taken by the camera, and there is a single window
+    glfwSetWindowRefreshCallback(glfw_window, refresh_callback);
+    glfwSetWindowIconifyCallback(glfw_window, iconify_callback);
+
     if (glfwRawMouseMotionSupported())
         glfwSetInputMode(glfw_window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
 
@@ -52,6 +83,42 @@ void Window::set_framebuffer_size_callback(void callback(GLFWwindow *, int, int)
     glfwSetFramebufferSizeCallback(glfw_window, callback);
 }
 
+bool Window::is_suspended()
+{
+    // GLFW does not tell whether the window is covered by others, only
+    // whether it is minimized or hidden
+    if (glfwGetWindowAttrib(glfw_window, GLFW_ICONIFIED) ||
+        !glfwGetWindowAttrib(glfw_window, GLFW_VISIBLE))
+        return true;
+
+    int width, height;
+    glfwGetFramebufferSize(glfw_window, &width, &height);
+    return width == 0 || height == 0;
+}
+
+bool Window::consume_damage()
+{
+    bool was_damaged = damaged;
+    damaged = false;
+    return was_damaged;
+}
+
+void Window::mark_damaged()
+{
+    damaged = true;
+}
+
+void Window::refresh_callback(GLFWwindow *window)
+{
+    damaged = true;
+}
+
+void Window::iconify_callback(GLFWwindow *window, int iconified)
+{
+    if (!iconified)
+        damaged = true;
+}
+
 void Window::maximize()
 {
     GLFWmonitor *monitor = glfwGetPrimaryMonitor();